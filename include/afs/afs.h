@@ -10,6 +10,24 @@ extern "C" {
 #define AFS_NUM_STREAMS             16
 #define AFS_WILDCARD_STREAM         UINT8_MAX
 
+// Set this to 1 (for both AFS and the code which uses it) to use 32-bit block numbers in order to support storage with
+// more than 65535 blocks
+#ifndef AFS_32BIT_BLOCKS
+#define AFS_32BIT_BLOCKS            0
+#endif
+
+//! Type used to represent a block number (or a number of blocks)
+#if AFS_32BIT_BLOCKS
+typedef uint32_t afs_block_t;
+#define AFS_BLOCK_MAX               UINT32_MAX
+#else
+typedef uint16_t afs_block_t;
+#define AFS_BLOCK_MAX               UINT16_MAX
+#endif
+
+//! Type used to represent an object ID (the lower 16 bits of which are never 0 for a valid object ID)
+typedef uint32_t afs_object_id_t;
+
 //! Type used to represent a stream bitmask
 typedef uint16_t afs_stream_bitmask_t;
 _Static_assert(sizeof(afs_stream_bitmask_t) * 8 == AFS_NUM_STREAMS, "Invalid bitmask size");
@@ -26,41 +44,106 @@ _Static_assert(sizeof(afs_stream_bitmask_t) * 8 == AFS_NUM_STREAMS, "Invalid bit
 
 //! Calculates the required size of the lookup table buffer
 #define AFS_LOOKUP_TABLE_SIZE(NUM_BLOCKS) \
-    ((sizeof(uint32_t) * (NUM_BLOCKS)) + ((NUM_BLOCKS) + 7) / 8)
+    ((sizeof(uint32_t) * (NUM_BLOCKS)) + (sizeof(afs_block_t) * 3 * (NUM_BLOCKS)) + (sizeof(uint16_t) * 2 * (NUM_BLOCKS)) + \
+        ((NUM_BLOCKS) + 7) / 8)
+
+//! Calculates the required size of the (optional) lookup table checkpoint region (which also holds the tombstone used by
+//! `afs_object_delete_deferred()`)
+#define AFS_CHECKPOINT_SIZE(NUM_BLOCKS, MIN_READ_WRITE_SIZE) \
+    (2 * (MIN_READ_WRITE_SIZE) + \
+        (((sizeof(uint32_t) + sizeof(uint16_t)) * (NUM_BLOCKS) + ((NUM_BLOCKS) + 7) / 8 + (MIN_READ_WRITE_SIZE) - 1) / \
+            (MIN_READ_WRITE_SIZE)) * (MIN_READ_WRITE_SIZE))
+
+//! Calculates the size of the (optional) lookup table extent buffer for the specified number of extents (runs of
+//! consecutive blocks of the same object)
+#define AFS_LOOKUP_TABLE_EXTENT_SIZE(MAX_EXTENTS) \
+    ((MAX_EXTENTS) * 3 * sizeof(uint32_t))
+
+//! Calculates the size of the (optional) mount buffer in order to batch the specified number of reads
+#define AFS_MOUNT_BUFFER_SIZE(NUM_READS, MIN_READ_WRITE_SIZE) \
+    ((NUM_READS) * ((MIN_READ_WRITE_SIZE) + sizeof(afs_read_request_t)))
+
+//! Calculates the size of the (optional) metadata cache buffer for the specified number of entries
+#define AFS_METADATA_CACHE_SIZE(NUM_ENTRIES, MIN_READ_WRITE_SIZE) \
+    ((NUM_ENTRIES) * ((MIN_READ_WRITE_SIZE) + 3 * sizeof(uint32_t)))
+
+//! Calculates the size of the (optional) seek table buffer used when writing an object in order to have a table of the
+//! offsets of up to the specified number of streams for every sub-block
+#define AFS_SEEK_TABLE_BUFFER_SIZE(SUB_BLOCKS_PER_BLOCK, NUM_STREAMS) \
+    (((SUB_BLOCKS_PER_BLOCK) - 1) * (NUM_STREAMS) * sizeof(uint32_t))
 
 //! Type used to define an AFS object handle - should be created with AFS_OBJECT_HANDLE_DEF()
 typedef struct __attribute__((aligned(sizeof(uintptr_t)))) {
     // Private memory used by AFS internally
-    uint8_t priv[sizeof(uintptr_t) == 8 ? 120 : 76];
+    uint8_t priv[sizeof(uintptr_t) == 8 ? (AFS_32BIT_BLOCKS ? 432 : 400) : (AFS_32BIT_BLOCKS ? 296 : 260)];
 } afs_handle_def_t;
 
 //! Type used to define an AFS object handle - should be created with AFS_OBJECT_HANDLE_DEF()
 typedef struct __attribute__((aligned(sizeof(uintptr_t)))) {
     // Private memory used by AFS internally
-    uint8_t priv[sizeof(uintptr_t) == 8 ? 264 : 248];
+    uint8_t priv[sizeof(uintptr_t) == 8 ? 320 : 288];
 } afs_object_handle_def_t;
 
 //! Function type for the object found mount callback
-typedef void (*afs_object_found_callback_t)(uint16_t object_id, uint8_t stream, const uint8_t* data, uint32_t data_length);
+typedef void (*afs_object_found_callback_t)(afs_object_id_t object_id, uint8_t stream, const uint8_t* data, uint32_t data_length);
+
+//! Type used to describe a single read within a batch of reads
+typedef struct {
+    // The buffer to read the data into
+    uint8_t* buf;
+    // The block to read from
+    afs_block_t block;
+    // The offset within the block to read from
+    uint32_t offset;
+    // The number of bytes to read
+    uint32_t length;
+} afs_read_request_t;
 
 //! Type to encapsulate the storage interface and configuration.
 typedef struct {
     // The size of a block (should match the AU size of the storage - typically 4MB)
     uint32_t block_size;
     // The total number of blocks
-    uint16_t num_blocks;
+    afs_block_t num_blocks;
     // The number of sub-blocks per block (block_size must be evenly divisible by this value - typically 256)
     uint32_t sub_blocks_per_block;
     // The minimum read/write size (should match the block size of the storage - typically 512 bytes)
     uint32_t min_read_write_size;
     // Function used to read data from the underlying storage device
-    void (*read)(uint8_t* buf, uint16_t block, uint32_t offset, uint32_t length);
+    void (*read)(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length);
     // Function used to write data to the underlying storage device
-    void (*write)(const uint8_t* buf, uint16_t block, uint32_t offset, uint32_t length);
+    void (*write)(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length);
     // Function used to erase a block on the underlying storage device
-    void (*erase)(uint16_t block);
+    void (*erase)(afs_block_t block);
+    // Optional function used to erase a contiguous range of blocks on the underlying storage device with a single
+    // operation (which is much cheaper than erasing each block on storage such as SD cards)
+    void (*erase_range)(afs_block_t first_block, afs_block_t num_blocks);
+    // Optional function used to perform a batch of reads from the underlying storage device, which may be serviced in
+    // any order and must all be complete when the function returns
+    void (*read_multi)(const afs_read_request_t* requests, uint32_t num_requests);
+    // Optional function used to start writing data to the underlying storage device in the background (the buffer
+    // must not be modified until the write is complete and writes must complete in the order they were started)
+    void (*write_async)(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length);
+    // Function used to wait for the background write of the specified buffer to complete (required if `write_async` is
+    // set)
+    void (*write_async_wait)(const uint8_t* buf);
+    // Optional function used to start reading data from the underlying storage device in the background
+    void (*read_async)(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length);
+    // Function used to wait for the background read into the specified buffer to complete (required if `read_async` is
+    // set)
+    void (*read_async_wait)(uint8_t* buf);
 } afs_storage_config_t;
 
+//! Type to encapsulate the (optional) lookup table checkpoint region interface and configuration.
+typedef struct {
+    // The size of the region (use `AFS_CHECKPOINT_SIZE()` to determine the required size)
+    uint32_t size;
+    // Function used to read data from the region (offset and length are multiples of the minimum read/write size)
+    void (*read)(uint8_t* buf, uint32_t offset, uint32_t length);
+    // Function used to write data to the region (offset and length are multiples of the minimum read/write size)
+    void (*write)(const uint8_t* buf, uint32_t offset, uint32_t length);
+} afs_checkpoint_config_t;
+
 //! AFS initialization type
 typedef struct {
     // Storage configuration
@@ -69,6 +152,35 @@ typedef struct {
     uint8_t* read_write_buffer;
     // Buffer for the lookup table used internally (use `AFS_LOOKUP_TABLE_SIZE()` to determine the required size)
     void* lookup_table_buffer;
+    // Optional buffer used to look up the blocks of objects via a binary search of the runs of consecutive blocks they
+    // occupy, which is used instead of the hash index within the lookup table until the storage is too fragmented for
+    // the runs to fit (use `AFS_LOOKUP_TABLE_EXTENT_SIZE()` to determine the required size)
+    void* lookup_table_extent_buffer;
+    // The size of the lookup table extent buffer
+    uint32_t lookup_table_extent_buffer_size;
+    // Optional region used to persist checkpoints of the lookup table in order to speed up mounting
+    afs_checkpoint_config_t checkpoint_config;
+    // Optional buffer used to batch the block header reads with `storage_config.read_multi` while mounting (use
+    // `AFS_MOUNT_BUFFER_SIZE()` to determine the required size)
+    void* mount_buffer;
+    // The size of the mount buffer
+    uint32_t mount_buffer_size;
+    // Optional buffer used to cache file system metadata (i.e. offset and seek chunks) which is read while seeking
+    // within objects and getting their size, with least-recently used replacement (use `AFS_METADATA_CACHE_SIZE()` to
+    // determine the required size for a given number of entries)
+    void* metadata_cache_buffer;
+    // The size of the metadata cache buffer
+    uint32_t metadata_cache_size;
+    // The number of erased blocks which `afs_maintenance()` keeps available so that writes don't need to erase blocks
+    // inline
+    afs_block_t erase_pool_low_water_mark;
+    // Optional function which returns a monotonic time in microseconds (required to use the time budget of
+    // `afs_idle_work()`)
+    uint32_t (*get_time_us)(void);
+    // Returns from `afs_init()` without reading the storage, leaving the caller to mount the file system incrementally
+    // via `afs_mount_step()` or in parallel via `afs_mount_scan()` and `afs_mount_finish()` (the two can't be mixed, and
+    // any other API call finishes mounting first if necessary, which isn't allowed once `afs_mount_scan()` is called)
+    bool defer_mount;
     // Optional callbacks used during mounting of the file system
     struct {
         // A handler to call as objects are found
@@ -82,6 +194,17 @@ typedef struct {
     uint8_t* buffer;
     // Size of the memory buffer (must either be a multiple of the sub-block size or vice-versa)
     uint32_t buffer_size;
+    // Optional second memory buffer of the same size which allows objects being written to keep filling one buffer
+    // while the other is written in the background with `storage_config.write_async`, and objects being read
+    // sequentially to read ahead into it in the background with `storage_config.read_async`
+    uint8_t* async_buffer;
+    // Optional buffer used when writing the object to build a table of the offsets of every sub-block, which is written
+    // before the footer of each block so that seeking within the block only needs to read the table rather than the
+    // seek chunks of the sub-blocks (use `AFS_SEEK_TABLE_BUFFER_SIZE()` to determine the required size for the maximum
+    // number of streams written to a single block, as blocks with more streams than that don't get a table)
+    void* seek_table_buffer;
+    // The size of the seek table buffer
+    uint32_t seek_table_buffer_size;
 } afs_object_config_t;
 
 //! Read position used by afs_object_save_read_position() and afs_object_restore_read_position()
@@ -93,11 +216,38 @@ typedef struct __attribute__((aligned(sizeof(uintptr_t)))) {
 //! Iterator context used by afs_object_list()
 typedef struct {
     // Private memory used by AFS internally
-    uint8_t priv[4];
+    uint8_t priv[2 * sizeof(afs_block_t)];
     // The current object ID
-    uint16_t object_id;
+    afs_object_id_t object_id;
 } afs_object_list_entry_t;
 
+//! Statistics which are tracked internally
+typedef struct {
+    // The number of file system metadata reads which were served from the metadata cache
+    uint32_t metadata_cache_hits;
+    // The number of file system metadata reads which had to go to the underlying storage
+    uint32_t metadata_cache_misses;
+    // The number of blocks which had to be erased inline while writing because no erased blocks were available
+    uint32_t num_inline_erases;
+    // The number of extents in the lookup table extent buffer (0 if blocks are being looked up via the hash index)
+    uint32_t num_lookup_table_extents;
+} afs_stats_t;
+
+//! Breakdown of how the blocks of the storage are being used
+typedef struct {
+    // The total number of blocks
+    afs_block_t num_blocks;
+    // The number of blocks which are in use by objects
+    afs_block_t num_used_blocks;
+    // The number of blocks which aren't in use by objects
+    afs_block_t num_free_blocks;
+    // The number of free blocks which are known to be erased
+    afs_block_t num_erased_blocks;
+    // The number of free blocks which need to be erased before they can be used (the remaining free blocks might
+    // already be erased)
+    afs_block_t num_garbage_blocks;
+} afs_usage_t;
+
 //! Type used to represent an AFS instance
 typedef afs_handle_def_t* afs_handle_t;
 
@@ -107,18 +257,31 @@ typedef afs_object_handle_def_t* afs_object_handle_t;
 //! Initializes and mounts the file system
 void afs_init(afs_handle_t afs_handle, const afs_init_t* init);
 
+//! Reads up to the specified number of blocks when mounting with `defer_mount` set and returns whether or not mounting
+//! is finished
+bool afs_mount_step(afs_handle_t afs_handle, afs_block_t max_blocks);
+
+//! Reads the specified range of blocks when mounting with `defer_mount` set. This may be called concurrently from
+//! multiple threads for disjoint ranges, each with its own read buffer of size `storage.min_read_write_size`, as long as
+//! each range starts on a multiple of 8 blocks (the object found callback is called from the calling thread)
+void afs_mount_scan(afs_handle_t afs_handle, afs_block_t first_block, afs_block_t num_blocks, uint8_t* read_buffer);
+
+//! Finishes mounting with `defer_mount` set once `afs_mount_scan()` has completed for every block (which must be done
+//! before calling any other API)
+void afs_mount_finish(afs_handle_t afs_handle);
+
 //! De-initializes the file system
 void afs_deinit(afs_handle_t afs_handle);
 
 //! Creates a new object for writing (returning the object ID)
-uint16_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_handle, const afs_object_config_t* config);
+afs_object_id_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_handle, const afs_object_config_t* config);
 
 //! Writes data to an object which was created with afs_object_create()
 //! Returns false on error (i.e. if the storage is full - see afs_is_storage_full())
 bool afs_object_write(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, const uint8_t* data, uint32_t length);
 
 //! Opens an existing object for reading (returns false if the object doesn't exist)
-bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, uint16_t object_id, const afs_object_config_t* config);
+bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, afs_object_id_t object_id, const afs_object_config_t* config);
 
 //! Reads data from the selected stream within an object which was opened with afs_object_open() and returns the number of bytes read
 uint32_t afs_object_read(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t* data, uint32_t max_length, uint8_t* stream);
@@ -144,22 +307,57 @@ bool afs_object_close(afs_handle_t afs_handle, afs_object_handle_t object_handle
 bool afs_object_list(afs_handle_t afs_handle, afs_object_list_entry_t* entry);
 
 //! Gets the number of blocks used by an object (will be larger than the actual object data size)
-uint16_t afs_object_get_num_blocks(afs_handle_t afs_handle, uint16_t object_id);
+uint16_t afs_object_get_num_blocks(afs_handle_t afs_handle, afs_object_id_t object_id);
 
 //! Deletes an object from the file system
-void afs_object_delete(afs_handle_t afs_handle, uint16_t object_id);
+void afs_object_delete(afs_handle_t afs_handle, afs_object_id_t object_id);
+
+//! Deletes multiple objects from the file system, erasing their first blocks together (any object IDs which don't exist
+//! are ignored, and objects which were previously deleted with `afs_object_delete_deferred()` are left to be erased
+//! later)
+void afs_object_delete_many(afs_handle_t afs_handle, const afs_object_id_t* object_ids, uint16_t num_objects);
+
+//! Deletes an object from the file system without erasing any of its blocks by recording it in a tombstone within the
+//! checkpoint region instead (its first block is erased later by `afs_idle_work()`, or when the storage is otherwise
+//! full). Falls back to `afs_object_delete()` if there's no checkpoint region or the tombstone is full.
+//! NOTE: The tombstone is only written once any blocks are about to be erased or written, or by `afs_idle_work()`,
+//! `afs_checkpoint()` or `afs_deinit()`, so that a series of deletions only writes it once (deletions which haven't been
+//! written yet are lost if power is lost before then)
+//! NOTE: Objects which are pending deletion may still be passed to the object found callback while mounting
+void afs_object_delete_deferred(afs_handle_t afs_handle, afs_object_id_t object_id);
 
 //! Deletes all objects from the file system
 void afs_wipe(afs_handle_t afs_handle, bool secure);
 
 //! Gets the total size of the file system as a total number of blocks being used
-uint16_t afs_size(afs_handle_t afs_handle);
+afs_block_t afs_size(afs_handle_t afs_handle);
 
 //! Returns whether or not the store is full (which causes writes to fail)
 bool afs_is_storage_full(afs_handle_t afs_handle);
 
 //! Prepares the backing storage for writing to the specified number of blocks.
-void afs_prepare_storage(afs_handle_t afs_handle, uint16_t num_blocks);
+void afs_prepare_storage(afs_handle_t afs_handle, afs_block_t num_blocks);
+
+//! Erases up to the specified number of free blocks in order to refill the pool of erased blocks up to
+//! `erase_pool_low_water_mark`, and returns whether or not the pool is full (or there is nothing left to erase). This is
+//! intended to be called periodically when the caller is otherwise idle.
+bool afs_maintenance(afs_handle_t afs_handle, afs_block_t max_erases);
+
+//! Performs deferred maintenance work (erasing free blocks which aren't known to be erased and writing a checkpoint of the lookup table if it has changed) until either the specified number of storage
+//! operations have been performed or the specified amount of time has elapsed (0 for no limit), and returns whether or
+//! not all the work is done. This is intended to be called when the caller is otherwise idle.
+bool afs_idle_work(afs_handle_t afs_handle, uint32_t max_operations, uint32_t max_time_us);
+
+//! Gets the internal statistics
+void afs_get_stats(afs_handle_t afs_handle, afs_stats_t* stats);
+
+//! Gets a breakdown of how the blocks of the storage are being used (in constant time, so it's cheap to poll)
+void afs_get_usage(afs_handle_t afs_handle, afs_usage_t* usage);
+
+//! Writes a checkpoint of the lookup table to the checkpoint region so that the next mount only needs to read the blocks
+//! which were free at this point (returns false if no checkpoint region is configured)
+//! NOTE: Deleting objects or wiping the file system invalidates the checkpoint
+bool afs_checkpoint(afs_handle_t afs_handle);
 
 #ifdef __cplusplus
 };
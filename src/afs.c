@@ -1,6 +1,9 @@
 #include "afs/afs.h"
 
 #include "afs_config.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "idle.h"
 #include "impl_types.h"
 #include "lookup_table.h"
 #include "open_object_list.h"
@@ -23,6 +26,36 @@
         AFS_ASSERT(impl->in_use); \
         impl; \
     })
+#define GET_AFS_IMPL_MOUNTED(HANDLE) ({ \
+        afs_impl_t* impl = GET_AFS_IMPL_IN_USE(HANDLE); \
+        if (impl->mount.is_pending) { \
+            /* The lookup table is needed, so finish mounting now (which would rescan every block if the blocks are \
+             * being scanned via afs_mount_scan()) */ \
+            AFS_ASSERT(!impl->mount.is_scanning); \
+            mount_step(impl, AFS_BLOCK_MAX); \
+        } \
+        impl; \
+    })
+
+static void finish_mount(afs_impl_t* afs) {
+    lookup_table_populate_finish(afs);
+    // Objects which were deleted without being erased are still on the storage, so delete them again
+    checkpoint_load_tombstone(afs);
+    afs->mount.is_pending = false;
+    // Mounting reads each block header once, so only start using the metadata cache now
+    afs->storage.metadata_cache = &afs->metadata_cache;
+}
+
+static bool mount_step(afs_impl_t* afs, afs_block_t max_blocks) {
+    const afs_block_t num_blocks = MIN_VAL(max_blocks, afs->storage_config.num_blocks - afs->mount.next_block);
+    lookup_table_populate_range(afs, &afs->storage, afs->mount.next_block, num_blocks);
+    afs->mount.next_block += num_blocks;
+    if (afs->mount.next_block < afs->storage_config.num_blocks) {
+        return false;
+    }
+    finish_mount(afs);
+    return true;
+}
 
 static void validate_object_buffer_size(const afs_storage_config_t* storage_config, uint32_t buffer_size) {
     AFS_ASSERT(buffer_size >= sizeof(block_header_t) + sizeof(chunk_header_t));
@@ -37,6 +70,20 @@ static void validate_object_buffer_size(const afs_storage_config_t* storage_conf
     AFS_ASSERT_EQ(buffer_size % storage_config->min_read_write_size, 0);
 }
 
+static uint8_t get_seek_table_max_streams(const afs_storage_config_t* storage_config, const afs_object_config_t* config) {
+    AFS_ASSERT(!config->seek_table_buffer_size || config->seek_table_buffer);
+    if (!config->seek_table_buffer || storage_config->sub_blocks_per_block == 1) {
+        // No seek tables (or nothing to put in them)
+        return 0;
+    }
+    const uint32_t max_streams = MIN_VAL(config->seek_table_buffer_size /
+        AFS_SEEK_TABLE_BUFFER_SIZE(storage_config->sub_blocks_per_block, 1), AFS_NUM_STREAMS);
+    AFS_ASSERT(max_streams > 0);
+    // The seek table is written within the block, so it needs to leave room for data
+    AFS_ASSERT(AFS_SEEK_TABLE_BUFFER_SIZE(storage_config->sub_blocks_per_block, max_streams) <= storage_config->block_size / 2);
+    return max_streams;
+}
+
 void afs_init(afs_handle_t afs_handle, const afs_init_t* init) {
     AFS_ASSERT(init);
     const afs_storage_config_t* storage_config = &init->storage_config;
@@ -47,17 +94,30 @@ void afs_init(afs_handle_t afs_handle, const afs_init_t* init) {
     AFS_ASSERT(storage_config->sub_blocks_per_block > 0 && (storage_config->block_size % storage_config->sub_blocks_per_block) == 0);
     AFS_ASSERT(storage_config->block_size / storage_config->sub_blocks_per_block >= BLOCK_FOOTER_LENGTH);
     AFS_ASSERT(storage_config->read && storage_config->write && storage_config->erase);
+    AFS_ASSERT(!storage_config->write_async || storage_config->write_async_wait);
+    AFS_ASSERT(!storage_config->read_async || storage_config->read_async_wait);
+    const afs_checkpoint_config_t* checkpoint_config = &init->checkpoint_config;
+    if (checkpoint_config->read || checkpoint_config->write) {
+        AFS_ASSERT(checkpoint_config->read && checkpoint_config->write);
+        AFS_ASSERT(checkpoint_config->size >= AFS_CHECKPOINT_SIZE(storage_config->num_blocks, storage_config->min_read_write_size));
+    }
+    AFS_ASSERT(!init->mount_buffer_size || init->mount_buffer);
+    AFS_ASSERT(!init->lookup_table_extent_buffer_size || init->lookup_table_extent_buffer);
+    AFS_ASSERT(!init->metadata_cache_size || init->metadata_cache_buffer);
 
     // Initialize the impl object and populate the lookup table from the storage
     afs_impl_t* afs = GET_IMPL(afs_impl_t, afs_handle);
     *afs = (afs_impl_t) {
         .in_use = true,
         .storage_config = *storage_config,
-        .lookup_table = {
-            .num_blocks = storage_config->num_blocks,
-            .values = init->lookup_table_buffer,
-            .version_bitmap = init->lookup_table_buffer + storage_config->num_blocks * sizeof(uint32_t),
+        .mount = {
+            .object_found = init->mount_callbacks.object_found,
         },
+        .checkpoint_config = *checkpoint_config,
+        .erase_pool = {
+            .low_water_mark = init->erase_pool_low_water_mark,
+        },
+        .get_time_us = init->get_time_us,
         .storage = {
             .config = &afs->storage_config,
             .cache = {
@@ -66,26 +126,84 @@ void afs_init(afs_handle_t afs_handle, const afs_init_t* init) {
             },
         },
     };
-    lookup_table_populate(afs, init->mount_callbacks.object_found);
+    lookup_table_init(&afs->lookup_table, storage_config->num_blocks, init->lookup_table_buffer,
+        init->lookup_table_extent_buffer, init->lookup_table_extent_buffer_size);
+    metadata_cache_init(&afs->metadata_cache, init->metadata_cache_buffer, init->metadata_cache_size, storage_config->min_read_write_size);
+    afs->mount.is_checkpoint_loaded = checkpoint_load(afs);
+    if (init->defer_mount) {
+        // The lookup table will be populated via afs_mount_step() or afs_mount_scan() (or as soon as it's needed)
+        afs->mount.is_pending = true;
+        return;
+    }
+    lookup_table_populate(afs, init->mount_buffer, init->mount_buffer_size);
+    finish_mount(afs);
+}
+
+bool afs_mount_step(afs_handle_t afs_handle, afs_block_t max_blocks) {
+    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    AFS_ASSERT(max_blocks > 0);
+    if (!afs->mount.is_pending) {
+        return true;
+    }
+    // Steps don't know which blocks have been scanned, so can't be mixed with afs_mount_scan()
+    AFS_ASSERT(!afs->mount.is_scanning);
+    return mount_step(afs, max_blocks);
+}
+
+void afs_mount_scan(afs_handle_t afs_handle, afs_block_t first_block, afs_block_t num_blocks, uint8_t* read_buffer) {
+    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    AFS_ASSERT(afs->mount.is_pending);
+    AFS_ASSERT(read_buffer);
+    // Each byte of the version bitmap covers 8 blocks, so ranges must not share a byte in order to be scanned
+    // concurrently
+    AFS_ASSERT_EQ(first_block % 8, 0);
+    AFS_ASSERT(num_blocks % 8 == 0 || first_block + num_blocks == afs->storage_config.num_blocks);
+    // Scans can't be mixed with afs_mount_step() (which would rescan any blocks which have already been scanned)
+    AFS_ASSERT_EQ(afs->mount.next_block, 0);
+    afs->mount.is_scanning = true;
+
+    // Use a separate storage context so that each caller has its own cache
+    storage_t storage = {
+        .config = &afs->storage_config,
+        .cache = {
+            .buffer = read_buffer,
+            .size = afs->storage_config.min_read_write_size,
+        },
+    };
+    lookup_table_populate_range(afs, &storage, first_block, num_blocks);
+}
+
+void afs_mount_finish(afs_handle_t afs_handle) {
+    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    AFS_ASSERT(afs->mount.is_pending);
+    finish_mount(afs);
 }
 
 void afs_deinit(afs_handle_t afs_handle) {
     afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
     AFS_ASSERT(open_object_list_is_empty(afs));
+    // Persist any deletions which haven't been recorded yet
+    checkpoint_flush_tombstone(afs);
     afs->in_use = false;
 }
 
-uint16_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_handle, const afs_object_config_t* config) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+afs_object_id_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_handle, const afs_object_config_t* config) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT(config && config->buffer);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_INVALID);
     validate_object_buffer_size(afs->storage.config, config->buffer_size);
+    const uint8_t seek_table_max_streams = get_seek_table_max_streams(afs->storage.config, config);
+    const afs_object_id_t object_id = lookup_table_get_next_object_id(afs);
 
     // Initialize the afs_obj_impl_t and add it to the open object list
     *obj = (afs_obj_impl_t) {
         .state = OBJ_STATE_WRITING,
-        .object_id = lookup_table_get_next_object_id(&afs->lookup_table),
+        .object_id = object_id,
+        .write = {
+            .seek_table_max_streams = seek_table_max_streams,
+            .seek_table = seek_table_max_streams ? config->seek_table_buffer : NULL,
+        },
         .storage = {
             .config = afs->storage.config,
             .cache = {
@@ -95,6 +213,7 @@ uint16_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_h
                     .block = INVALID_BLOCK,
                 },
             },
+            .async_buffer = afs->storage_config.write_async ? config->async_buffer : NULL,
         },
     };
     open_object_list_add(afs, obj);
@@ -103,7 +222,7 @@ uint16_t afs_object_create(afs_handle_t afs_handle, afs_object_handle_t object_h
 
 bool afs_object_write(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, const uint8_t* data, uint32_t length) {
     AFS_ASSERT(data && length);
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_WRITING);
     AFS_ASSERT(stream < AFS_NUM_STREAMS);
@@ -118,8 +237,8 @@ bool afs_object_write(afs_handle_t afs_handle, afs_object_handle_t object_handle
     return true;
 }
 
-bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, uint16_t object_id, const afs_object_config_t* config) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t stream, afs_object_id_t object_id, const afs_object_config_t* config) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT(config && config->buffer);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_INVALID);
@@ -128,9 +247,9 @@ bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle,
     validate_object_buffer_size(afs->storage.config, config->buffer_size);
 
     // Find the first block from our lookup table
-    const uint16_t block = lookup_table_get_block(&afs->lookup_table, object_id, 0);
+    const afs_block_t block = lookup_table_get_block(&afs->lookup_table, object_id, 0);
     if (block == INVALID_BLOCK) {
-        AFS_LOG_WARN("Did not find block (object_id=%u)", object_id);
+        AFS_LOG_WARN("Did not find block (object_id=%"PRIu32")", object_id);
         return false;
     }
 
@@ -147,6 +266,7 @@ bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle,
                     .block = block,
                 },
             },
+            .async_buffer = afs->storage_config.read_async ? config->async_buffer : NULL,
         },
     };
     open_object_list_add(afs, obj);
@@ -155,7 +275,7 @@ bool afs_object_open(afs_handle_t afs_handle, afs_object_handle_t object_handle,
 
 uint32_t afs_object_read(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint8_t* data, uint32_t max_length, uint8_t* stream) {
     AFS_ASSERT(data && max_length);
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_READING);
     if (obj->read.stream == AFS_WILDCARD_STREAM) {
@@ -185,7 +305,7 @@ uint32_t afs_object_read(afs_handle_t afs_handle, afs_object_handle_t object_han
 }
 
 bool afs_object_seek(afs_handle_t afs_handle, afs_object_handle_t object_handle, uint64_t offset) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_READING);
 
@@ -205,7 +325,7 @@ bool afs_object_seek(afs_handle_t afs_handle, afs_object_handle_t object_handle,
 }
 
 uint64_t afs_object_size(afs_handle_t afs_handle, afs_object_handle_t object_handle, afs_stream_bitmask_t stream_bitmask) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_READING);
     if (obj->read.stream == AFS_WILDCARD_STREAM) {
@@ -263,7 +383,7 @@ void afs_object_save_read_position(afs_handle_t afs_handle, afs_object_handle_t
 }
 
 void afs_object_restore_read_position(afs_handle_t afs_handle, afs_object_handle_t object_handle, afs_read_position_t* read_position) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     (void)afs;
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_EQ(obj->state, OBJ_STATE_READING);
@@ -277,12 +397,15 @@ void afs_object_restore_read_position(afs_handle_t afs_handle, afs_object_handle
 }
 
 bool afs_object_close(afs_handle_t afs_handle, afs_object_handle_t object_handle) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_obj_impl_t* obj = GET_IMPL(afs_obj_impl_t, object_handle);
     AFS_ASSERT_NOT_EQ(obj->state, OBJ_STATE_INVALID);
 
     if (obj->state == OBJ_STATE_WRITING && !object_write_finish(afs, obj)) {
         return false;
+    } else if (obj->state == OBJ_STATE_READING) {
+        // Wait for any read ahead to complete before giving the buffers back
+        storage_sync(&obj->storage);
     }
 
     open_object_list_remove(afs, obj);
@@ -291,18 +414,18 @@ bool afs_object_close(afs_handle_t afs_handle, afs_object_handle_t object_handle
 }
 
 bool afs_object_list(afs_handle_t afs_handle, afs_object_list_entry_t* entry) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     afs_object_list_entry_impl_t* context = GET_IMPL(afs_object_list_entry_impl_t, entry);
 
     // Find the next block which contains the first block of an object
-    const uint16_t object_id = lookup_table_iter_get_next_object(&afs->lookup_table, &context->block);
+    const afs_object_id_t object_id = lookup_table_iter_get_next_object(&afs->lookup_table, &context->block);
     if (object_id != INVALID_OBJECT_ID) {
         entry->object_id = object_id;
         return true;
     }
 
     // Check the objects which are open for writing and haven't written to the storage yet
-    const uint16_t next_object_id = open_object_list_get_writing_no_storage(afs, context->open_index);
+    const afs_object_id_t next_object_id = open_object_list_get_writing_no_storage(afs, context->open_index);
     if (next_object_id == INVALID_OBJECT_ID) {
         return false;
     }
@@ -311,29 +434,82 @@ bool afs_object_list(afs_handle_t afs_handle, afs_object_list_entry_t* entry) {
     return true;
 }
 
-uint16_t afs_object_get_num_blocks(afs_handle_t afs_handle, uint16_t object_id) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+uint16_t afs_object_get_num_blocks(afs_handle_t afs_handle, afs_object_id_t object_id) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     AFS_ASSERT_NOT_EQ(object_id, INVALID_OBJECT_ID);
     return lookup_table_get_num_blocks(&afs->lookup_table, object_id);
 }
 
-void afs_object_delete(afs_handle_t afs_handle, uint16_t object_id) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+void afs_object_delete(afs_handle_t afs_handle, afs_object_id_t object_id) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     AFS_ASSERT_NOT_EQ(object_id, INVALID_OBJECT_ID);
 
     // Make sure the object isn't open
     AFS_ASSERT(!open_object_list_contains(afs, object_id));
 
-    // Remove the object from our lookup table
-    AFS_LOG_DEBUG("Deleting object (%u)", object_id);
-    const uint16_t first_block = lookup_table_delete_object(&afs->lookup_table, object_id);
+    // Remove the object from our lookup table (which makes any checkpoint stale)
+    AFS_LOG_DEBUG("Deleting object (%"PRIu32")", object_id);
+    checkpoint_invalidate(afs);
+    const afs_block_t first_block = lookup_table_delete_object(&afs->lookup_table, object_id, false);
     storage_erase(&afs->storage, first_block);
 }
 
+void afs_object_delete_many(afs_handle_t afs_handle, const afs_object_id_t* object_ids, uint16_t num_objects) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    for (uint16_t i = 0; i < num_objects; i++) {
+        AFS_ASSERT_NOT_EQ(object_ids[i], INVALID_OBJECT_ID);
+        // Make sure the object isn't open
+        AFS_ASSERT(!open_object_list_contains(afs, object_ids[i]));
+    }
+
+    // Remove each of the objects from our lookup table (which makes any checkpoint stale) and erase their first blocks
+    // together, with adjacent ones erased as a range
+    AFS_LOG_DEBUG("Deleting objects (num_objects=%u)", num_objects);
+    checkpoint_invalidate(afs);
+    erase_batch_t erase_batch = {};
+    for (uint16_t i = 0; i < num_objects; i++) {
+        if (lookup_table_get_block(&afs->lookup_table, object_ids[i], 0) == INVALID_BLOCK) {
+            // Doesn't exist (or was listed more than once)
+            continue;
+        }
+        const afs_block_t first_block = lookup_table_delete_object(&afs->lookup_table, object_ids[i], false);
+        storage_erase_batch_add(&afs->storage, &erase_batch, first_block);
+    }
+    storage_erase_batch_flush(&afs->storage, &erase_batch);
+}
+
+void afs_object_delete_deferred(afs_handle_t afs_handle, afs_object_id_t object_id) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    AFS_ASSERT_NOT_EQ(object_id, INVALID_OBJECT_ID);
+    if (lookup_table_get_num_deleted(&afs->lookup_table) >= checkpoint_get_tombstone_capacity(afs)) {
+        // There's no room to record the deletion, so erase the first block now
+        afs_object_delete(afs_handle, object_id);
+        return;
+    }
+
+    // Make sure the object isn't open
+    AFS_ASSERT(!open_object_list_contains(afs, object_id));
+
+    // Remove the object from our lookup table, leaving it to be recorded in the tombstone along with any other deletions
+    // before any of its blocks are erased or reused (the checkpoint stays valid until then too)
+    AFS_LOG_DEBUG("Deleting object (%"PRIu32") without erasing it", object_id);
+    lookup_table_delete_object(&afs->lookup_table, object_id, true);
+    checkpoint_set_tombstone_pending(afs);
+}
+
 void afs_wipe(afs_handle_t afs_handle, bool secure) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     AFS_ASSERT(open_object_list_is_empty(afs));
-    uint16_t block = 0;
+    checkpoint_flush_tombstone(afs);
+    checkpoint_invalidate(afs);
+    if (secure) {
+        // The first blocks of objects which were deleted without being erased are still on the storage, so erase them
+        // (and remove them from the tombstone) first
+        idle_erase_deleted_blocks(afs);
+    }
+    // Erase adjacent blocks together as we go
+    erase_batch_t erase_batch = {};
+    afs_block_t block = 0;
     while (true) {
         bool should_erase = secure;
         block = lookup_table_wipe_next_in_use(&afs->lookup_table, block, &should_erase);
@@ -341,38 +517,61 @@ void afs_wipe(afs_handle_t afs_handle, bool secure) {
             break;
         }
         if (should_erase) {
-            storage_erase(&afs->storage, block);
+            storage_erase_batch_add(&afs->storage, &erase_batch, block);
         }
     }
+    storage_erase_batch_flush(&afs->storage, &erase_batch);
 }
 
-uint16_t afs_size(afs_handle_t afs_handle) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+afs_block_t afs_size(afs_handle_t afs_handle) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     return lookup_table_get_total_num_blocks(&afs->lookup_table);
 }
 
 bool afs_is_storage_full(afs_handle_t afs_handle) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     return lookup_table_is_full(&afs->lookup_table);
 }
 
-void afs_prepare_storage(afs_handle_t afs_handle, uint16_t num_blocks) {
-    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+void afs_prepare_storage(afs_handle_t afs_handle, afs_block_t num_blocks) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
     AFS_ASSERT(num_blocks > 0);
-    // Check how many are already erased
-    const uint16_t num_erased = lookup_table_get_num_erased(&afs->lookup_table);
-    if (num_erased >= num_blocks) {
-        return;
-    }
-    num_blocks -= num_erased;
-    // Find some blocks which can be erased
-    uint16_t erase_block = 0;
-    while (num_blocks > 0) {
-        erase_block = lookup_table_get_next_pending_erase(&afs->lookup_table, erase_block);
-        if (erase_block == INVALID_BLOCK) {
-            break;
-        }
-        storage_erase(&afs->storage, erase_block);
-        num_blocks--;
+    idle_erase_free_blocks(afs, num_blocks, AFS_BLOCK_MAX);
+}
+
+bool afs_maintenance(afs_handle_t afs_handle, afs_block_t max_erases) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    return idle_erase_free_blocks(afs, afs->erase_pool.low_water_mark, max_erases);
+}
+
+bool afs_idle_work(afs_handle_t afs_handle, uint32_t max_operations, uint32_t max_time_us) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    AFS_ASSERT(!max_time_us || afs->get_time_us);
+    return idle_work(afs, max_operations, max_time_us);
+}
+
+void afs_get_stats(afs_handle_t afs_handle, afs_stats_t* stats) {
+    afs_impl_t* afs = GET_AFS_IMPL_IN_USE(afs_handle);
+    AFS_ASSERT(stats);
+    *stats = (afs_stats_t) {
+        .metadata_cache_hits = afs->metadata_cache.num_hits,
+        .metadata_cache_misses = afs->metadata_cache.num_misses,
+        .num_inline_erases = afs->erase_pool.num_inline_erases,
+        .num_lookup_table_extents = afs->lookup_table.num_extents,
+    };
+}
+
+void afs_get_usage(afs_handle_t afs_handle, afs_usage_t* usage) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    AFS_ASSERT(usage);
+    lookup_table_get_usage(&afs->lookup_table, usage);
+}
+
+bool afs_checkpoint(afs_handle_t afs_handle) {
+    afs_impl_t* afs = GET_AFS_IMPL_MOUNTED(afs_handle);
+    if (!afs->checkpoint_config.write) {
+        return false;
     }
+    checkpoint_write(afs);
+    return true;
 }
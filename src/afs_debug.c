@@ -14,7 +14,7 @@
     for (VAR = (chunk_iter_context_t) {.block = block}; chunk_iter_next(AFS, &(VAR));)
 
 typedef struct {
-    uint16_t block;
+    afs_block_t block;
     chunk_header_t header;
     uint32_t offset;
     uint8_t data[32];
@@ -29,7 +29,13 @@ static inline afs_impl_t* get_afs_impl(afs_handle_t handle) {
 
 static bool chunk_iter_next(afs_impl_t* afs, chunk_iter_context_t* context) {
     if (context->offset == 0) {
-        context->offset += sizeof(block_header_t);
+        position_t header_position = {
+            .block = context->block,
+            .offset = 0,
+        };
+        block_header_t block_header;
+        storage_read_block_header(&afs->storage, &header_position, &block_header);
+        context->offset = header_position.offset;
     } else {
         context->offset += sizeof(chunk_header_t) + CHUNK_TAG_GET_LENGTH(context->header.tag);
     }
@@ -50,6 +56,7 @@ static bool chunk_iter_next(afs_impl_t* afs, chunk_iter_context_t* context) {
         case CHUNK_TYPE_SEEK:
             storage_read_data(&afs->storage, &position, context->data, MIN_VAL(data_length, sizeof(context->data)));
             return true;
+        case CHUNK_TYPE_SEEK_TABLE:
         case CHUNK_TYPE_END:
             return true;
         case CHUNK_TYPE_INVALID_ZERO:
@@ -143,6 +150,9 @@ static bool chunk_iter_callback(afs_impl_t* afs, const chunk_iter_context_t* chu
             populate_seek_chunk_data_string(data_str, chunk_iter);
             AFS_LOG_INFO("  [0x%06"PRIx32"]=Seek(num=%u, data=%s)", chunk_iter->offset, (uint8_t)(CHUNK_TAG_GET_LENGTH(chunk_iter->header.tag) / sizeof(uint32_t)), data_str);
             break;
+        case CHUNK_TYPE_SEEK_TABLE:
+            AFS_LOG_INFO("  [0x%06"PRIx32"]=SeekTable(length=%"PRIu32")", chunk_iter->offset, CHUNK_TAG_GET_LENGTH(chunk_iter->header.tag));
+            break;
         case CHUNK_TYPE_INVALID_ZERO:
         case CHUNK_TYPE_INVALID_ONE:
         default:
@@ -155,12 +165,12 @@ static bool chunk_iter_callback(afs_impl_t* afs, const chunk_iter_context_t* chu
 void afs_dump(afs_handle_t afs_handle) {
     afs_impl_t* afs = get_afs_impl(afs_handle);
     // Iterate over the blocks from the lookup table
-    for (uint16_t block = 0; block < afs->storage_config.num_blocks; block++) {
+    for (afs_block_t block = 0; block < afs->storage_config.num_blocks; block++) {
         afs_dump_block(afs_handle, block, UINT32_MAX);
     }
 }
 
-void afs_dump_block(afs_handle_t afs_handle, uint16_t block, uint32_t max_chunks) {
+void afs_dump_block(afs_handle_t afs_handle, afs_block_t block, uint32_t max_chunks) {
     afs_impl_t* afs = get_afs_impl(afs_handle);
 
     // Dump the block info from the lookup table
@@ -178,7 +188,7 @@ void afs_dump_block(afs_handle_t afs_handle, uint16_t block, uint32_t max_chunks
     }
 }
 
-void afs_dump_object(afs_handle_t afs_handle, uint16_t object_id) {
+void afs_dump_object(afs_handle_t afs_handle, afs_object_id_t object_id) {
     afs_impl_t* afs = get_afs_impl(afs_handle);
     // Dump the object from the lookup table
     lookup_table_debug_dump_object(&afs->lookup_table, object_id);
@@ -43,3 +43,82 @@ void cache_invalidate(cache_t* cache, const position_t* position, uint32_t lengt
     }
     cache->length = 0;
 }
+
+void metadata_cache_init(metadata_cache_t* metadata_cache, void* buffer, uint32_t buffer_size, uint32_t entry_size) {
+    // The buffer contains the data of each entry followed by the entries themselves
+    const uint16_t num_entries = MIN_VAL(buffer_size / (entry_size + sizeof(metadata_cache_entry_t)), UINT16_MAX);
+    if (!num_entries) {
+        *metadata_cache = (metadata_cache_t) {
+            .entry_size = entry_size,
+        };
+        return;
+    }
+    *metadata_cache = (metadata_cache_t) {
+        .entries = (metadata_cache_entry_t*)((uint8_t*)buffer + num_entries * entry_size),
+        .buffer = buffer,
+        .num_entries = num_entries,
+        .entry_size = entry_size,
+    };
+    for (uint16_t i = 0; i < num_entries; i++) {
+        metadata_cache->entries[i] = (metadata_cache_entry_t) {
+            .position = {
+                .block = INVALID_BLOCK,
+            },
+        };
+    }
+}
+
+bool metadata_cache_read(metadata_cache_t* metadata_cache, const position_t* position, void* buf) {
+    metadata_cache->access_counter++;
+    for (uint16_t i = 0; i < metadata_cache->num_entries; i++) {
+        metadata_cache_entry_t* entry = &metadata_cache->entries[i];
+        if (entry->position.block != position->block || entry->position.offset != position->offset) {
+            continue;
+        }
+        entry->last_used = metadata_cache->access_counter;
+        memcpy(buf, &metadata_cache->buffer[i * metadata_cache->entry_size], metadata_cache->entry_size);
+        metadata_cache->num_hits++;
+        return true;
+    }
+    metadata_cache->num_misses++;
+    return false;
+}
+
+void metadata_cache_write(metadata_cache_t* metadata_cache, const position_t* position, const void* data) {
+    if (!metadata_cache->num_entries) {
+        return;
+    }
+    // Replace the least-recently used entry (unused entries have never been used so are picked first)
+    uint16_t index = 0;
+    for (uint16_t i = 0; i < metadata_cache->num_entries; i++) {
+        const metadata_cache_entry_t* entry = &metadata_cache->entries[i];
+        if (entry->position.block == INVALID_BLOCK) {
+            index = i;
+            break;
+        } else if (entry->last_used < metadata_cache->entries[index].last_used) {
+            index = i;
+        }
+    }
+    metadata_cache->entries[index] = (metadata_cache_entry_t) {
+        .position = *position,
+        .last_used = metadata_cache->access_counter,
+    };
+    memcpy(&metadata_cache->buffer[index * metadata_cache->entry_size], data, metadata_cache->entry_size);
+}
+
+void metadata_cache_invalidate(metadata_cache_t* metadata_cache, const position_t* position, uint32_t length) {
+    for (uint16_t i = 0; i < metadata_cache->num_entries; i++) {
+        metadata_cache_entry_t* entry = &metadata_cache->entries[i];
+        if (entry->position.block != position->block) {
+            // Different block
+            continue;
+        } else if (position->offset >= entry->position.offset + metadata_cache->entry_size) {
+            // Beyond the end of what's cached
+            continue;
+        } else if (position->offset + length <= entry->position.offset) {
+            // Before the start of what's cached
+            continue;
+        }
+        entry->position.block = INVALID_BLOCK;
+    }
+}
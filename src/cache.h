@@ -17,3 +17,15 @@ void cache_write(cache_t* cache, const void* data, uint32_t length);
 
 //! Invalidates any portion of the cache with overlaps with the specified region
 void cache_invalidate(cache_t* cache, const position_t* position, uint32_t length);
+
+//! Initializes a metadata cache within the provided buffer
+void metadata_cache_init(metadata_cache_t* metadata_cache, void* buffer, uint32_t buffer_size, uint32_t entry_size);
+
+//! Reads the data for a position from the metadata cache (returns false if it's not in the cache)
+bool metadata_cache_read(metadata_cache_t* metadata_cache, const position_t* position, void* buf);
+
+//! Writes the data for a position into the metadata cache, replacing the least-recently used entry
+void metadata_cache_write(metadata_cache_t* metadata_cache, const position_t* position, const void* data);
+
+//! Invalidates any entries of the metadata cache which overlap with the specified region
+void metadata_cache_invalidate(metadata_cache_t* metadata_cache, const position_t* position, uint32_t length);
@@ -0,0 +1,229 @@
+#include "checkpoint.h"
+
+#include "afs_config.h"
+#include "lookup_table.h"
+#include "storage_types.h"
+#include "util.h"
+
+#include <string.h>
+
+// The checkpoint region is read and written through the file system cache buffer in chunks of its size (which is the
+// minimum read / write size) with the header in the first chunk, the lookup table data in the following ones and the
+// tombstone in the last one. The tombstone is independent of the checkpoint itself and lists the first blocks of
+// objects which were deleted without being erased.
+
+static uint8_t* get_buffer(afs_impl_t* afs) {
+    // We're reusing the file system cache's buffer, so wipe the cache
+    afs->storage.cache.length = 0;
+    return afs->storage.cache.buffer;
+}
+
+static uint32_t get_block_number_size(const afs_impl_t* afs) {
+    // Block numbers are stored as 16 bits whenever they fit so that the format is the same regardless of whether AFS is
+    // built with 32-bit block numbers
+#if AFS_32BIT_BLOCKS
+    return afs->storage_config.num_blocks <= UINT16_MAX ? sizeof(uint16_t) : sizeof(uint32_t);
+#else
+    return sizeof(uint16_t);
+#endif
+}
+
+static void put_block_number(const afs_impl_t* afs, uint8_t* buf, afs_block_t block) {
+    if (get_block_number_size(afs) == sizeof(uint16_t)) {
+        const uint16_t value = block;
+        memcpy(buf, &value, sizeof(value));
+    } else {
+        const uint32_t value = block;
+        memcpy(buf, &value, sizeof(value));
+    }
+}
+
+static afs_block_t get_block_number(const afs_impl_t* afs, const uint8_t* buf) {
+    if (get_block_number_size(afs) == sizeof(uint16_t)) {
+        uint16_t value;
+        memcpy(&value, buf, sizeof(value));
+        return value;
+    } else {
+        uint32_t value;
+        memcpy(&value, buf, sizeof(value));
+        return value;
+    }
+}
+
+static uint32_t get_tombstone_offset(const afs_impl_t* afs) {
+    const uint32_t chunk_size = afs->storage.cache.size;
+    return chunk_size + ALIGN_UP(lookup_table_get_checkpoint_length(&afs->lookup_table), chunk_size);
+}
+
+bool checkpoint_load(afs_impl_t* afs) {
+    const afs_checkpoint_config_t* config = &afs->checkpoint_config;
+    if (!config->read) {
+        return false;
+    }
+    uint8_t* buffer = get_buffer(afs);
+    const uint32_t chunk_size = afs->storage.cache.size;
+
+    // Read and validate the header
+    config->read(buffer, 0, chunk_size);
+    checkpoint_header_t header;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic.val != CHECKPOINT_MAGIC_VALUE.val) {
+        AFS_LOG_DEBUG("No checkpoint found");
+        return false;
+    } else if (header.block_size != afs->storage_config.block_size || header.num_blocks != afs->storage_config.num_blocks) {
+        AFS_LOG_WARN("Checkpoint does not match the storage (block_size=%"PRIu32", num_blocks=%"PRIu32")", header.block_size, header.num_blocks);
+        return false;
+    }
+
+    // Read the lookup table data (the lookup table is fully populated from the storage if the checksum doesn't match)
+    const uint32_t length = lookup_table_get_checkpoint_length(&afs->lookup_table);
+    uint32_t checksum = 0;
+    for (uint32_t offset = 0; offset < length; offset += chunk_size) {
+        config->read(buffer, chunk_size + offset, chunk_size);
+        const uint32_t data_length = MIN_VAL(length - offset, chunk_size);
+        checksum = util_crc32(checksum, buffer, data_length);
+        lookup_table_set_checkpoint_data(&afs->lookup_table, offset, buffer, data_length);
+    }
+    afs->checkpoint.generation = header.generation;
+    if (checksum != header.checksum) {
+        AFS_LOG_WARN("Invalid checkpoint checksum (0x%08"PRIx32" != 0x%08"PRIx32")", checksum, header.checksum);
+        return false;
+    }
+
+    AFS_LOG_DEBUG("Loaded checkpoint (generation=%"PRIu32")", header.generation);
+    afs->checkpoint.is_valid = true;
+    return true;
+}
+
+void checkpoint_write(afs_impl_t* afs) {
+    const afs_checkpoint_config_t* config = &afs->checkpoint_config;
+    AFS_ASSERT(config->write);
+    // The checkpoint doesn't contain the objects which were deleted without being erased, so they need to be in the
+    // tombstone
+    if (afs->checkpoint.is_tombstone_pending) {
+        checkpoint_write_tombstone(afs);
+    }
+    uint8_t* buffer = get_buffer(afs);
+    const uint32_t chunk_size = afs->storage.cache.size;
+
+    // Write the lookup table data before the header so that an interrupted write leaves the checksum mismatched
+    const uint32_t length = lookup_table_get_checkpoint_length(&afs->lookup_table);
+    uint32_t checksum = 0;
+    for (uint32_t offset = 0; offset < length; offset += chunk_size) {
+        lookup_table_get_checkpoint_data(afs, offset, buffer, chunk_size);
+        checksum = util_crc32(checksum, buffer, MIN_VAL(length - offset, chunk_size));
+        config->write(buffer, chunk_size + offset, chunk_size);
+    }
+
+    // Write the header
+    const checkpoint_header_t header = {
+        .magic = CHECKPOINT_MAGIC_VALUE,
+        .generation = afs->checkpoint.generation + 1,
+        .block_size = afs->storage_config.block_size,
+        .num_blocks = afs->storage_config.num_blocks,
+        .checksum = checksum,
+    };
+    memset(buffer, 0, chunk_size);
+    memcpy(buffer, &header, sizeof(header));
+    config->write(buffer, 0, chunk_size);
+    AFS_LOG_DEBUG("Wrote checkpoint (generation=%"PRIu32")", header.generation);
+    afs->checkpoint.generation = header.generation;
+    afs->checkpoint.is_valid = true;
+    afs->checkpoint.is_written = true;
+    afs->checkpoint.num_table_changes = afs->lookup_table.num_changes;
+}
+
+bool checkpoint_is_current(const afs_impl_t* afs) {
+    return afs->checkpoint.is_valid && afs->checkpoint.is_written &&
+        afs->checkpoint.num_table_changes == afs->lookup_table.num_changes;
+}
+
+void checkpoint_invalidate(afs_impl_t* afs) {
+    if (!afs->checkpoint.is_valid) {
+        return;
+    }
+    // Overwrite the header
+    uint8_t* buffer = get_buffer(afs);
+    memset(buffer, 0, afs->storage.cache.size);
+    afs->checkpoint_config.write(buffer, 0, afs->storage.cache.size);
+    AFS_LOG_DEBUG("Invalidated checkpoint (generation=%"PRIu32")", afs->checkpoint.generation);
+    afs->checkpoint.is_valid = false;
+}
+
+uint16_t checkpoint_get_tombstone_capacity(const afs_impl_t* afs) {
+    if (!afs->checkpoint_config.write) {
+        return 0;
+    }
+    return (afs->storage.cache.size - sizeof(tombstone_header_t)) / get_block_number_size(afs);
+}
+
+void checkpoint_load_tombstone(afs_impl_t* afs) {
+    const afs_checkpoint_config_t* config = &afs->checkpoint_config;
+    if (!config->read) {
+        return;
+    }
+    uint8_t* buffer = get_buffer(afs);
+    config->read(buffer, get_tombstone_offset(afs), afs->storage.cache.size);
+    tombstone_header_t header;
+    memcpy(&header, buffer, sizeof(header));
+    if (header.magic.val != TOMBSTONE_MAGIC_VALUE.val) {
+        return;
+    } else if (header.num_blocks > checkpoint_get_tombstone_capacity(afs)) {
+        AFS_LOG_ERROR("Invalid tombstone (num_blocks=%u)", header.num_blocks);
+        return;
+    }
+    const uint8_t* blocks = &buffer[sizeof(header)];
+    const uint32_t block_number_size = get_block_number_size(afs);
+    if (util_crc32(0, blocks, header.num_blocks * block_number_size) != header.checksum) {
+        AFS_LOG_ERROR("Invalid tombstone checksum");
+        return;
+    }
+    AFS_LOG_DEBUG("Loaded tombstone (num_blocks=%u)", header.num_blocks);
+    for (uint16_t i = 0; i < header.num_blocks; i++) {
+        if (!lookup_table_delete_first_block(&afs->lookup_table, get_block_number(afs, &blocks[i * block_number_size]))) {
+            // The block was erased without the tombstone being updated (i.e. we lost power in between), so the entry
+            // needs to be removed before the block can be reused by another object
+            checkpoint_set_tombstone_pending(afs);
+        }
+    }
+}
+
+void checkpoint_write_tombstone(afs_impl_t* afs) {
+    const afs_checkpoint_config_t* config = &afs->checkpoint_config;
+    AFS_ASSERT(config->write);
+    uint8_t* buffer = get_buffer(afs);
+    memset(buffer, 0, afs->storage.cache.size);
+
+    // Fill in the list of blocks
+    tombstone_header_t header = {
+        .magic = TOMBSTONE_MAGIC_VALUE,
+        .num_blocks = lookup_table_get_num_deleted(&afs->lookup_table),
+    };
+    AFS_ASSERT(header.num_blocks <= checkpoint_get_tombstone_capacity(afs));
+    uint8_t* blocks = &buffer[sizeof(header)];
+    const uint32_t block_number_size = get_block_number_size(afs);
+    afs_block_t block = INVALID_BLOCK;
+    for (uint16_t i = 0; i < header.num_blocks; i++) {
+        block = lookup_table_get_next_deleted(&afs->lookup_table, block);
+        put_block_number(afs, &blocks[i * block_number_size], block);
+    }
+    header.checksum = util_crc32(0, blocks, header.num_blocks * block_number_size);
+    memcpy(buffer, &header, sizeof(header));
+    config->write(buffer, get_tombstone_offset(afs), afs->storage.cache.size);
+    AFS_LOG_DEBUG("Wrote tombstone (num_blocks=%u)", header.num_blocks);
+    afs->checkpoint.is_tombstone_pending = false;
+}
+
+void checkpoint_set_tombstone_pending(afs_impl_t* afs) {
+    AFS_ASSERT(afs->checkpoint_config.write);
+    afs->checkpoint.is_tombstone_pending = true;
+}
+
+void checkpoint_flush_tombstone(afs_impl_t* afs) {
+    if (!afs->checkpoint.is_tombstone_pending) {
+        return;
+    }
+    // The checkpoint still has the deleted objects in it, which is fine until their blocks change
+    checkpoint_invalidate(afs);
+    checkpoint_write_tombstone(afs);
+}
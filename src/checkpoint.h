@@ -0,0 +1,33 @@
+#pragma once
+
+#include "impl_types.h"
+
+#include <stdbool.h>
+
+//! Loads the lookup table values from the checkpoint region and returns whether or not a valid checkpoint was found
+bool checkpoint_load(afs_impl_t* afs);
+
+//! Writes the current lookup table to the checkpoint region
+void checkpoint_write(afs_impl_t* afs);
+
+//! Returns whether or not the checkpoint region contains a checkpoint of the current lookup table
+bool checkpoint_is_current(const afs_impl_t* afs);
+
+//! Invalidates the checkpoint region if it currently contains a valid checkpoint
+void checkpoint_invalidate(afs_impl_t* afs);
+
+//! Gets the maximum number of blocks the tombstone can hold (0 if there's no checkpoint region)
+uint16_t checkpoint_get_tombstone_capacity(const afs_impl_t* afs);
+
+//! Loads the tombstone from the checkpoint region and deletes any objects which it lists from the lookup table
+void checkpoint_load_tombstone(afs_impl_t* afs);
+
+//! Writes the list of deleted objects whose first block hasn't been erased yet to the tombstone
+void checkpoint_write_tombstone(afs_impl_t* afs);
+
+//! Records that an object was deleted without being erased, which is only written to the tombstone once it's flushed
+void checkpoint_set_tombstone_pending(afs_impl_t* afs);
+
+//! Writes the tombstone if objects have been deleted without being erased since it was last written, invalidating the
+//! checkpoint first (which must be done before any blocks of the deleted objects are erased or reused)
+void checkpoint_flush_tombstone(afs_impl_t* afs);
@@ -12,5 +12,11 @@ _Static_assert(sizeof(afs_object_list_entry_impl_t) == sizeof(((afs_object_list_
 _Static_assert(sizeof(((afs_read_pos_impl_t*)0)->object_offset) == sizeof(((afs_obj_impl_t*)0)->object_offset), "Invalid object_offset sizes");
 _Static_assert(sizeof(((afs_read_pos_impl_t*)0)->block_offset) == sizeof(((afs_obj_impl_t*)0)->block_offset), "Invalid block_offset sizes");
 
+// Make sure the metadata cache entries fit within the space allocated by AFS_METADATA_CACHE_SIZE()
+_Static_assert(sizeof(metadata_cache_entry_t) <= 3 * sizeof(uint32_t), "Invalid metadata cache entry size");
+
+// Make sure the lookup table extents fit within the space allocated by AFS_LOOKUP_TABLE_EXTENT_SIZE()
+_Static_assert(sizeof(lookup_extent_t) <= 3 * sizeof(uint32_t), "Invalid lookup table extent size");
+
 // Make sure the footer fits within the allocated space
-_Static_assert(sizeof(block_footer_t) + sizeof(chunk_header_t) + AFS_NUM_STREAMS * sizeof(uint32_t) <= BLOCK_FOOTER_LENGTH, "Overflowing footer space");
+_Static_assert(sizeof(block_footer_t) + 2 * sizeof(chunk_header_t) + AFS_NUM_STREAMS * sizeof(uint32_t) <= BLOCK_FOOTER_LENGTH, "Overflowing footer space");
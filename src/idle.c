@@ -0,0 +1,127 @@
+#include "idle.h"
+
+#include "afs_config.h"
+#include "checkpoint.h"
+#include "lookup_table.h"
+#include "storage.h"
+
+// The deferred work is done in priority order, with each storage operation (erasing a block or writing a checkpoint)
+// counting against the budget:
+//   1. Erasing the first blocks of objects which were deleted without being erased (and updating the tombstone, which
+//      also records any deletions which were still pending)
+//   2. Erasing free blocks to refill the erase pool up to its low-water mark
+//   3. Erasing the remaining free blocks which aren't known to be erased (including those which might already be erased,
+//      since erasing one costs a single operation whereas checking it would mean reading the entire block)
+//   4. Writing a checkpoint of the lookup table if it has changed since the last one
+
+typedef struct {
+    // The AFS instance (for the time function and erasing batched blocks)
+    afs_impl_t* afs;
+    // The remaining number of storage operations
+    uint32_t remaining_operations;
+    // The time when the work was started
+    uint32_t start_time;
+    // The maximum amount of time to spend (or 0 for no limit)
+    uint32_t max_time_us;
+    // Blocks which are pending being erased (coalesced into a range)
+    erase_batch_t erase_batch;
+} budget_t;
+
+static bool budget_take(budget_t* budget) {
+    if (!budget->remaining_operations) {
+        return false;
+    } else if (budget->max_time_us) {
+        // Erase any batched blocks first so that the time they take counts against the budget
+        storage_erase_batch_flush(&budget->afs->storage, &budget->erase_batch);
+        if ((uint32_t)(budget->afs->get_time_us() - budget->start_time) >= budget->max_time_us) {
+            return false;
+        }
+    }
+    budget->remaining_operations--;
+    return true;
+}
+
+static bool erase_blocks(afs_impl_t* afs, budget_t* budget, afs_block_t num_erased) {
+    bool result = true;
+    while (lookup_table_get_num_erased(&afs->lookup_table) < num_erased) {
+        if (!budget_take(budget)) {
+            result = false;
+            break;
+        }
+        const afs_block_t erase_block = lookup_table_get_next_pending_erase(&afs->lookup_table);
+        if (erase_block == INVALID_BLOCK) {
+            // Nothing left to erase
+            budget->remaining_operations++;
+            break;
+        }
+        // The block might belong to an object which was deleted without the deletion being recorded yet
+        checkpoint_flush_tombstone(afs);
+        storage_erase_batch_add(&afs->storage, &budget->erase_batch, erase_block);
+    }
+    storage_erase_batch_flush(&afs->storage, &budget->erase_batch);
+    return result;
+}
+
+static bool erase_deleted_blocks(afs_impl_t* afs, budget_t* budget) {
+    bool result = true;
+    bool is_tombstone_stale = false;
+    while (lookup_table_get_num_deleted(&afs->lookup_table)) {
+        if (!budget_take(budget)) {
+            result = false;
+            break;
+        }
+        // The checkpoint still has the object in it
+        checkpoint_invalidate(afs);
+        storage_erase_batch_add(&afs->storage, &budget->erase_batch, lookup_table_erase_next_deleted(&afs->lookup_table));
+        is_tombstone_stale = true;
+    }
+    storage_erase_batch_flush(&afs->storage, &budget->erase_batch);
+    if (is_tombstone_stale) {
+        // Remove the erased blocks from the tombstone before they can be allocated again (they're erased first since
+        // losing power in between would otherwise bring the deleted objects back, whereas the stale entries this
+        // leaves instead are found when mounting and removed before any blocks are allocated)
+        checkpoint_write_tombstone(afs);
+    }
+    return result;
+}
+
+static bool write_checkpoint(afs_impl_t* afs, budget_t* budget) {
+    if (!afs->checkpoint_config.write || checkpoint_is_current(afs)) {
+        return true;
+    } else if (!budget_take(budget)) {
+        return false;
+    }
+    checkpoint_write(afs);
+    return true;
+}
+
+bool idle_erase_free_blocks(afs_impl_t* afs, afs_block_t num_erased, afs_block_t max_erases) {
+    budget_t budget = {
+        .afs = afs,
+        .remaining_operations = max_erases,
+    };
+    return erase_blocks(afs, &budget, num_erased);
+}
+
+afs_block_t idle_erase_deleted_blocks(afs_impl_t* afs) {
+    const afs_block_t num_deleted = lookup_table_get_num_deleted(&afs->lookup_table);
+    budget_t budget = {
+        .afs = afs,
+        .remaining_operations = UINT32_MAX,
+    };
+    erase_deleted_blocks(afs, &budget);
+    return num_deleted;
+}
+
+bool idle_work(afs_impl_t* afs, uint32_t max_operations, uint32_t max_time_us) {
+    budget_t budget = {
+        .afs = afs,
+        .remaining_operations = max_operations ? max_operations : UINT32_MAX,
+        .start_time = max_time_us ? afs->get_time_us() : 0,
+        .max_time_us = max_time_us,
+    };
+    return erase_deleted_blocks(afs, &budget) &&
+        erase_blocks(afs, &budget, afs->erase_pool.low_water_mark) &&
+        erase_blocks(afs, &budget, AFS_BLOCK_MAX) &&
+        write_checkpoint(afs, &budget);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "impl_types.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+
+//! Erases free blocks until at least the specified number are erased (or there are no more to erase), performing at
+//! most `max_erases` erases, and returns whether or not the number of erased blocks was reached
+bool idle_erase_free_blocks(afs_impl_t* afs, afs_block_t num_erased, afs_block_t max_erases);
+
+//! Erases the first blocks of all the objects which were deleted without being erased and returns how many there were
+afs_block_t idle_erase_deleted_blocks(afs_impl_t* afs);
+
+//! Performs deferred maintenance work within the specified budget and returns whether or not all of it is done
+bool idle_work(afs_impl_t* afs, uint32_t max_operations, uint32_t max_time_us);
@@ -6,7 +6,15 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
-#define INVALID_BLOCK                           UINT16_MAX
+#define INVALID_BLOCK                           AFS_BLOCK_MAX
+#if AFS_32BIT_BLOCKS
+#define PRI_BLOCK                               PRIu32
+#else
+#define PRI_BLOCK                               "u"
+#endif
+#define LOOKUP_TABLE_NUM_FREE_STATES            5
+#define SEEK_TABLE_NO_COLUMN                    UINT8_MAX
+#define SEEK_TABLE_TOO_MANY_STREAMS             UINT8_MAX
 
 typedef struct {
     // Pointer to the underlying buffer
@@ -19,22 +27,111 @@ typedef struct {
     position_t position;
 } cache_t;
 
+typedef struct {
+    // The position of the cached data (the block is INVALID_BLOCK if the entry is unused)
+    position_t position;
+    // The value of the access counter when the entry was last used
+    uint32_t last_used;
+} metadata_cache_entry_t;
+
+typedef struct {
+    // The entries
+    metadata_cache_entry_t* entries;
+    // The buffer containing the data of all the entries (each of which is the minimum read/write size)
+    uint8_t* buffer;
+    // The number of entries
+    uint16_t num_entries;
+    // The size of the data of each entry
+    uint32_t entry_size;
+    // Incremented on every access in order to find the least-recently used entry
+    uint32_t access_counter;
+    // The number of reads which were served from the cache
+    uint32_t num_hits;
+    // The number of reads which had to go to the underlying storage
+    uint32_t num_misses;
+} metadata_cache_t;
+
+typedef enum {
+    ASYNC_STATE_IDLE = 0,
+    ASYNC_STATE_WRITING,
+    ASYNC_STATE_READING,
+} async_state_t;
+
 typedef struct {
     // The storage config
     const afs_storage_config_t* config;
     // The cache object
     cache_t cache;
+    // Optional cache of previously-read data which sits in front of the underlying storage
+    metadata_cache_t* metadata_cache;
+    // Optional second buffer which is swapped with the cache buffer as it's written or read asynchronously
+    uint8_t* async_buffer;
+    // The asynchronous operation which is currently pending on the async buffer
+    async_state_t async_state;
+    // The position being read into the async buffer
+    position_t async_position;
 } storage_t;
 
 typedef struct {
-    // The number of blocks in the storage
+    // The first block of the range of blocks which are pending being erased
+    afs_block_t first_block;
+    // The number of blocks in the range
+    afs_block_t num_blocks;
+} erase_batch_t;
+
+typedef struct {
+    // The first block in the list
+    afs_block_t head;
+    // The last block in the list
+    afs_block_t tail;
+    // The number of blocks in the list
+    afs_block_t count;
+} free_list_t;
+
+typedef struct {
+    // The object ID
+    afs_object_id_t object_id;
+    // The object block index of the first block in the extent
+    uint16_t first_object_block_index;
+    // The number of consecutive blocks in the extent
     uint16_t num_blocks;
-    // Lookup table values
+    // The first block of the extent
+    afs_block_t first_block;
+} lookup_extent_t;
+
+typedef struct {
+    // The number of blocks in the storage
+    afs_block_t num_blocks;
+    // Lists of free blocks for each block state
+    free_list_t free_lists[LOOKUP_TABLE_NUM_FREE_STATES];
+    // The total number of blocks across all the free lists
+    afs_block_t num_free;
+    // Lookup table values (which contain the lower 16 bits of the object ID)
     uint32_t* values;
+    // The upper 16 bits of the object ID of each block which is in use (or the first block of a deleted object which
+    // hasn't been erased yet)
+    uint16_t* object_id_high;
+    // Hash index of blocks which are in use, keyed by lookup table value (open addressing with linear probing)
+    afs_block_t* index;
+    // Optional table of runs of consecutive blocks which are in use by the same object, sorted by object ID and object
+    // block index, which is used instead of the hash index until the blocks are too fragmented for it
+    lookup_extent_t* extents;
+    // The number of extents the table has room for
+    uint32_t max_extents;
+    // The number of extents in the table
+    uint32_t num_extents;
+    // Whether or not blocks are being looked up via the extent table (otherwise the hash index is used)
+    bool use_extents;
+    // The next block within the free list each free block is in
+    afs_block_t* free_list_next;
+    // The number of blocks in each object, indexed by the object's first block (only valid for first blocks)
+    uint16_t* object_num_blocks;
     // Version bitmap
     uint8_t* version_bitmap;
     // Seed used to generate object IDs
     uint32_t object_id_seed;
+    // Incremented whenever a value is changed after mounting (used to tell whether a checkpoint is out of date)
+    uint32_t num_changes;
 } lookup_table_t;
 
 typedef enum {
@@ -50,7 +147,7 @@ typedef struct afs_obj_impl {
     // State
     obj_state_t state;
     // Object ID
-    uint16_t object_id;
+    afs_object_id_t object_id;
     // The current offset within the object of each stream
     uint64_t object_offset[AFS_NUM_STREAMS];
     // The current offset within the block of each stream
@@ -68,6 +165,15 @@ typedef struct afs_obj_impl {
     struct {
         // The index of the next block within the object
         uint16_t next_block_index;
+        // The number of streams in the seek table of the current block (or SEEK_TABLE_TOO_MANY_STREAMS)
+        uint8_t seek_table_num_streams;
+        // The number of streams which the seek table buffer has room for (or 0 if seek tables aren't being written)
+        uint8_t seek_table_max_streams;
+        // The column of each stream within the seek table buffer (or SEEK_TABLE_NO_COLUMN)
+        uint8_t seek_table_columns[AFS_NUM_STREAMS];
+        // Buffer used to build the seek table of the current block, with a row of offsets for every sub-block after the
+        // first and a column for each stream (in the order they were first written to the block)
+        uint32_t* seek_table;
     } write;
     // The storage context for the object
     storage_t storage;
@@ -81,10 +187,46 @@ typedef struct {
     afs_storage_config_t storage_config;
     // The lookup table
     lookup_table_t lookup_table;
+    struct {
+        // The object found callback
+        afs_object_found_callback_t object_found;
+        // Whether or not the lookup table was loaded from a checkpoint
+        bool is_checkpoint_loaded;
+        // Whether or not the lookup table still needs to be populated before mounting is finished
+        bool is_pending;
+        // Whether or not the lookup table is being populated via afs_mount_scan()
+        bool is_scanning;
+        // The next block to populate for incremental mounting
+        afs_block_t next_block;
+    } mount;
+    // The checkpoint config
+    afs_checkpoint_config_t checkpoint_config;
+    struct {
+        // The generation of the most recent checkpoint
+        uint32_t generation;
+        // Whether or not the checkpoint region currently contains a valid checkpoint
+        bool is_valid;
+        // Whether or not a checkpoint has been written since mounting
+        bool is_written;
+        // Whether or not objects have been deleted without being erased since the tombstone was last written
+        bool is_tombstone_pending;
+        // The lookup table's number of changes when the checkpoint was last written
+        uint32_t num_table_changes;
+    } checkpoint;
+    struct {
+        // The number of erased blocks to keep available
+        afs_block_t low_water_mark;
+        // The number of blocks which were erased inline while writing
+        uint32_t num_inline_erases;
+    } erase_pool;
+    // The function used to get the current time for budgeting idle work
+    uint32_t (*get_time_us)(void);
     // Open object linked list
     afs_obj_impl_t* open_object_list_head;
     // The storage context for file system operations
     storage_t storage;
+    // The metadata cache used by the storage context for file system operations once mounted
+    metadata_cache_t metadata_cache;
 } afs_impl_t;
 
 // In-memory context for the read position
@@ -104,7 +246,7 @@ typedef struct {
 // In-memory context for listing objects
 typedef struct {
     // The current block
-    uint16_t block;
+    afs_block_t block;
     // The index into the open objects list
     uint16_t open_index;
 } afs_object_list_entry_impl_t;
@@ -7,7 +7,7 @@
 //! Type used to represent a position within the file system
 typedef struct {
     // The block index
-    uint16_t block;
+    afs_block_t block;
     // The offset within the block
     uint32_t offset;
 } position_t;
@@ -24,4 +24,14 @@ typedef struct {
     uint32_t offsets[AFS_NUM_STREAMS];
 } seek_chunk_data_t;
 
+//! Type used to represent the location of the seek table of a block
+typedef struct {
+    // The offset of the first sub-block's offsets within the block
+    uint32_t offset;
+    // The streams which have offsets in the table
+    afs_stream_bitmask_t stream_bitmask;
+    // The number of streams which have offsets in the table
+    uint8_t num_streams;
+} seek_table_t;
+
 #pragma pack(pop)
@@ -1,6 +1,7 @@
 #include "lookup_table.h"
 
 #include "afs_config.h"
+#include "open_object_list.h"
 #include "storage.h"
 #include "util.h"
 
@@ -10,7 +11,11 @@
 #define LOOKUP_TABLE_BLOCK_STATE_MAYBE_ERASED   0x0001
 #define LOOKUP_TABLE_BLOCK_STATE_UNKNOWN        0x0002
 #define LOOKUP_TABLE_BLOCK_STATE_GARBAGE        0x0003
+// The first block of an object which was deleted without being erased, which can't be allocated until it's erased
+#define LOOKUP_TABLE_BLOCK_STATE_DELETED        0x0004
 
+// The lookup table values only contain the lower 16 bits of the object ID (which are never 0 for an object which
+// exists), with the upper 16 bits kept in a separate array
 #define LOOKUP_TABLE_GET_OBJECT_ID(X) ((uint16_t)((X) >> 16))
 #define LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(X) ((uint16_t)(X))
 #define LOOKUP_TABLE_GET_BLOCK_STATE(X) ((uint16_t)(X))
@@ -19,27 +24,462 @@
 #define LOOKUP_TABLE_FREE_BLOCK_VALUE(STATE) \
     LOOKUP_TABLE_VALUE(INVALID_OBJECT_ID, STATE)
 
-static inline void set_value(lookup_table_t* lookup_table, uint16_t block, uint16_t object_id, uint16_t object_block_index) {
+#define OBJECT_ID_HIGH(OBJECT_ID)               ((uint16_t)((OBJECT_ID) >> 16))
+// The number of random object IDs to try before searching for an unused one
+#define OBJECT_ID_MAX_RANDOM_ATTEMPTS           16
+
+// Scans of the lookup table values check a step of values at a time using SIMD instructions where they're available
+// (AVX2, SSE2 or NEON), and otherwise check one value at a time
+#define SCAN_VECTORS_PER_STEP                   4
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define VALUES_PER_VECTOR                       8
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define VALUES_PER_VECTOR                       4
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define VALUES_PER_VECTOR                       4
+#endif
+#ifdef VALUES_PER_VECTOR
+#define VALUES_PER_SCAN_STEP                    (VALUES_PER_VECTOR * SCAN_VECTORS_PER_STEP)
+#endif
+
+#define INDEX_EMPTY_SLOT                        INVALID_BLOCK
+#define INDEX_NUM_SLOTS(NUM_BLOCKS)             ((uint32_t)(NUM_BLOCKS) * 2)
+
+static inline bool is_in_use(uint32_t value) {
+    return LOOKUP_TABLE_GET_OBJECT_ID(value) != INVALID_OBJECT_ID;
+}
+
+static inline bool is_object_id_valid(afs_object_id_t object_id) {
+    // The lower 16 bits of the object ID are what distinguish the values of blocks which are in use from free ones
+    return LOOKUP_TABLE_GET_OBJECT_ID(LOOKUP_TABLE_VALUE(object_id, 0)) != INVALID_OBJECT_ID;
+}
+
+static inline afs_object_id_t get_object_id(const lookup_table_t* lookup_table, afs_block_t block) {
+    return (afs_object_id_t)lookup_table->object_id_high[block] << 16 | LOOKUP_TABLE_GET_OBJECT_ID(lookup_table->values[block]);
+}
+
+static bool is_deleted_object_id_high(const lookup_table_t* lookup_table, uint16_t object_id_high) {
+    // The first blocks of deleted objects which haven't been erased yet are still on the storage, but only the upper 16
+    // bits of their object IDs are kept, so any object ID which shares them might be in use
+    const afs_block_t* free_list_next = lookup_table->free_list_next;
+    for (afs_block_t block = lookup_table->free_lists[LOOKUP_TABLE_BLOCK_STATE_DELETED].head; block != INVALID_BLOCK; block = free_list_next[block]) {
+        if (lookup_table->object_id_high[block] == object_id_high) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool is_value_match(uint32_t value, uint32_t eq_mask, uint32_t eq_value, uint32_t nonzero_mask) {
+    return (value & eq_mask) == eq_value && (value & nonzero_mask) != 0;
+}
+
+#ifdef VALUES_PER_SCAN_STEP
+//! Gets a bitmask of which of the next VALUES_PER_SCAN_STEP values match the specified masks (see `is_value_match()`)
+static inline uint32_t get_scan_step_matches(const uint32_t* values, uint32_t eq_mask, uint32_t eq_value, uint32_t nonzero_mask) {
+    uint32_t matches = 0;
+#if defined(__AVX2__)
+    const __m256i eq_mask_vector = _mm256_set1_epi32((int32_t)eq_mask);
+    const __m256i eq_value_vector = _mm256_set1_epi32((int32_t)eq_value);
+    const __m256i nonzero_mask_vector = _mm256_set1_epi32((int32_t)nonzero_mask);
+    const __m256i zero_vector = _mm256_setzero_si256();
+    for (uint32_t i = 0; i < VALUES_PER_SCAN_STEP; i += VALUES_PER_VECTOR) {
+        const __m256i vector = _mm256_loadu_si256((const __m256i*)&values[i]);
+        const __m256i is_eq = _mm256_cmpeq_epi32(_mm256_and_si256(vector, eq_mask_vector), eq_value_vector);
+        const __m256i is_zero = _mm256_cmpeq_epi32(_mm256_and_si256(vector, nonzero_mask_vector), zero_vector);
+        matches |= (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(is_zero, is_eq))) << i;
+    }
+#elif defined(__SSE2__)
+    const __m128i eq_mask_vector = _mm_set1_epi32((int32_t)eq_mask);
+    const __m128i eq_value_vector = _mm_set1_epi32((int32_t)eq_value);
+    const __m128i nonzero_mask_vector = _mm_set1_epi32((int32_t)nonzero_mask);
+    const __m128i zero_vector = _mm_setzero_si128();
+    for (uint32_t i = 0; i < VALUES_PER_SCAN_STEP; i += VALUES_PER_VECTOR) {
+        const __m128i vector = _mm_loadu_si128((const __m128i*)&values[i]);
+        const __m128i is_eq = _mm_cmpeq_epi32(_mm_and_si128(vector, eq_mask_vector), eq_value_vector);
+        const __m128i is_zero = _mm_cmpeq_epi32(_mm_and_si128(vector, nonzero_mask_vector), zero_vector);
+        matches |= (uint32_t)_mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(is_zero, is_eq))) << i;
+    }
+#elif defined(__ARM_NEON)
+    // NEON doesn't have a movemask instruction, so select a bit for each lane and add them together instead
+    static const uint32_t lane_bits[VALUES_PER_VECTOR] = {1, 2, 4, 8};
+    const uint32x4_t lane_bits_vector = vld1q_u32(lane_bits);
+    const uint32x4_t eq_mask_vector = vdupq_n_u32(eq_mask);
+    const uint32x4_t eq_value_vector = vdupq_n_u32(eq_value);
+    const uint32x4_t nonzero_mask_vector = vdupq_n_u32(nonzero_mask);
+    for (uint32_t i = 0; i < VALUES_PER_SCAN_STEP; i += VALUES_PER_VECTOR) {
+        const uint32x4_t vector = vld1q_u32(&values[i]);
+        const uint32x4_t is_eq = vceqq_u32(vandq_u32(vector, eq_mask_vector), eq_value_vector);
+        const uint32x4_t match_bits = vandq_u32(vandq_u32(is_eq, vtstq_u32(vector, nonzero_mask_vector)), lane_bits_vector);
+        uint32x2_t sum = vpadd_u32(vget_low_u32(match_bits), vget_high_u32(match_bits));
+        sum = vpadd_u32(sum, sum);
+        matches |= vget_lane_u32(sum, 0) << i;
+    }
+#endif
+    return matches;
+}
+#endif
+
+//! Finds the first block starting from the specified one whose value matches the specified masks (see
+//! `is_value_match()`), or returns INVALID_BLOCK if there are none
+static afs_block_t find_next_value_match(const lookup_table_t* lookup_table, afs_block_t start_block, uint32_t eq_mask, uint32_t eq_value, uint32_t nonzero_mask) {
+    const uint32_t* values = lookup_table->values;
+    uint32_t block = start_block;
+#ifdef VALUES_PER_SCAN_STEP
+    // Check a step of values at a time
+    while (block + VALUES_PER_SCAN_STEP <= lookup_table->num_blocks) {
+        const uint32_t matches = get_scan_step_matches(&values[block], eq_mask, eq_value, nonzero_mask);
+        if (matches) {
+            return block + __builtin_ctz(matches);
+        }
+        block += VALUES_PER_SCAN_STEP;
+    }
+#endif
+    // Check any remaining values one at a time
+    for (; block < lookup_table->num_blocks; block++) {
+        if (is_value_match(values[block], eq_mask, eq_value, nonzero_mask)) {
+            return block;
+        }
+    }
+    return INVALID_BLOCK;
+}
+
+static inline afs_block_t find_next_in_use(const lookup_table_t* lookup_table, afs_block_t start_block) {
+    return find_next_value_match(lookup_table, start_block, 0, 0, 0xffff0000);
+}
+
+static inline afs_block_t find_next_first_block(const lookup_table_t* lookup_table, afs_block_t start_block) {
+    return find_next_value_match(lookup_table, start_block, 0x0000ffff, 0, 0xffff0000);
+}
+
+static afs_block_t find_next_object_block(const lookup_table_t* lookup_table, afs_block_t start_block, afs_object_id_t object_id) {
+    // The values only contain the lower 16 bits of the object ID, so check the upper 16 bits of each match
+    for (afs_block_t block = start_block;; block++) {
+        block = find_next_value_match(lookup_table, block, 0xffff0000, LOOKUP_TABLE_VALUE(object_id, 0), 0xffffffff);
+        if (block == INVALID_BLOCK || lookup_table->object_id_high[block] == OBJECT_ID_HIGH(object_id)) {
+            return block;
+        }
+    }
+}
+
+static inline uint32_t index_get_home_slot(const lookup_table_t* lookup_table, uint32_t value, uint16_t object_id_high) {
+    // Mix all the bits of the value and the upper bits of the object ID together so that both the object ID and the
+    // object block index are spread across the index (even when the number of slots is a power of 2)
+    value ^= object_id_high * 0x9e3779b1;
+    value ^= value >> 16;
+    value *= 0x45d9f3b;
+    value ^= value >> 16;
+    return value % INDEX_NUM_SLOTS(lookup_table->num_blocks);
+}
+
+static inline uint32_t index_get_next_slot(const lookup_table_t* lookup_table, uint32_t slot) {
+    slot++;
+    return slot == INDEX_NUM_SLOTS(lookup_table->num_blocks) ? 0 : slot;
+}
+
+static void index_insert(lookup_table_t* lookup_table, afs_block_t block) {
+    uint32_t slot = index_get_home_slot(lookup_table, lookup_table->values[block], lookup_table->object_id_high[block]);
+    while (lookup_table->index[slot] != INDEX_EMPTY_SLOT) {
+        slot = index_get_next_slot(lookup_table, slot);
+    }
+    lookup_table->index[slot] = block;
+}
+
+static void index_remove(lookup_table_t* lookup_table, afs_block_t block) {
+    // Find the slot which contains the block (the lookup value must not have been changed yet)
+    uint32_t empty_slot = index_get_home_slot(lookup_table, lookup_table->values[block], lookup_table->object_id_high[block]);
+    while (lookup_table->index[empty_slot] != block) {
+        AFS_ASSERT_NOT_EQ(lookup_table->index[empty_slot], INDEX_EMPTY_SLOT);
+        empty_slot = index_get_next_slot(lookup_table, empty_slot);
+    }
+
+    // Shift any following entries back into the emptied slot as necessary so that lookups never hit a gap before
+    // reaching their entry
+    uint32_t slot = index_get_next_slot(lookup_table, empty_slot);
+    while (lookup_table->index[slot] != INDEX_EMPTY_SLOT) {
+        const afs_block_t slot_block = lookup_table->index[slot];
+        const uint32_t home_slot = index_get_home_slot(lookup_table, lookup_table->values[slot_block], lookup_table->object_id_high[slot_block]);
+        const bool can_move = slot > empty_slot ?
+            (home_slot <= empty_slot || home_slot > slot) :
+            (home_slot <= empty_slot && home_slot > slot);
+        if (can_move) {
+            lookup_table->index[empty_slot] = lookup_table->index[slot];
+            empty_slot = slot;
+        }
+        slot = index_get_next_slot(lookup_table, slot);
+    }
+    lookup_table->index[empty_slot] = INDEX_EMPTY_SLOT;
+}
+
+static afs_block_t index_find(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index) {
+    // Return the lowest matching block in case there are duplicate entries
+    const uint32_t value = LOOKUP_TABLE_VALUE(object_id, object_block_index);
+    const uint16_t object_id_high = OBJECT_ID_HIGH(object_id);
+    afs_block_t result = INVALID_BLOCK;
+    uint32_t slot = index_get_home_slot(lookup_table, value, object_id_high);
+    while (lookup_table->index[slot] != INDEX_EMPTY_SLOT) {
+        const afs_block_t block = lookup_table->index[slot];
+        if (lookup_table->values[block] == value && lookup_table->object_id_high[block] == object_id_high && block < result) {
+            result = block;
+        }
+        slot = index_get_next_slot(lookup_table, slot);
+    }
+    return result;
+}
+
+static inline bool extent_contains(const lookup_extent_t* extent, afs_object_id_t object_id, uint16_t object_block_index) {
+    return extent->object_id == object_id && object_block_index >= extent->first_object_block_index &&
+        object_block_index - extent->first_object_block_index < extent->num_blocks;
+}
+
+//! Binary searches for the index of the first extent which starts after the specified block of an object
+static uint32_t extent_upper_bound(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index) {
+    uint32_t low = 0;
+    uint32_t high = lookup_table->num_extents;
+    while (low < high) {
+        const uint32_t mid = low + (high - low) / 2;
+        const lookup_extent_t* extent = &lookup_table->extents[mid];
+        if (extent->object_id < object_id ||
+                (extent->object_id == object_id && extent->first_object_block_index <= object_block_index)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static afs_block_t extent_find(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index) {
+    const uint32_t i = extent_upper_bound(lookup_table, object_id, object_block_index);
+    if (i == 0 || !extent_contains(&lookup_table->extents[i - 1], object_id, object_block_index)) {
+        return INVALID_BLOCK;
+    }
+    const lookup_extent_t* extent = &lookup_table->extents[i - 1];
+    return extent->first_block + (object_block_index - extent->first_object_block_index);
+}
+
+//! Adds a block which is in use to the extent table, returning false if it doesn't fit or if it's a duplicate of
+//! another block (which the hash index handles)
+static bool extent_insert(lookup_table_t* lookup_table, afs_block_t block) {
+    const afs_object_id_t object_id = get_object_id(lookup_table, block);
+    const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_table->values[block]);
+    lookup_extent_t* extents = lookup_table->extents;
+    const uint32_t i = extent_upper_bound(lookup_table, object_id, object_block_index);
+    lookup_extent_t* prev = i > 0 ? &extents[i - 1] : NULL;
+    lookup_extent_t* next = i < lookup_table->num_extents ? &extents[i] : NULL;
+    if (prev && extent_contains(prev, object_id, object_block_index)) {
+        return false;
+    }
+    // Extend the neighbouring extents if the block continues either of them (merging them if it joins the two)
+    const bool extends_prev = prev && prev->object_id == object_id && prev->num_blocks < UINT16_MAX &&
+        prev->first_object_block_index + prev->num_blocks == object_block_index && prev->first_block + prev->num_blocks == block;
+    const bool extends_next = next && next->object_id == object_id && next->num_blocks < UINT16_MAX &&
+        object_block_index + 1 == next->first_object_block_index && block + 1 == next->first_block;
+    if (extends_prev && extends_next && (uint32_t)prev->num_blocks + 1 + next->num_blocks <= UINT16_MAX) {
+        prev->num_blocks += 1 + next->num_blocks;
+        memmove(next, next + 1, (lookup_table->num_extents - i - 1) * sizeof(lookup_extent_t));
+        lookup_table->num_extents--;
+    } else if (extends_prev) {
+        prev->num_blocks++;
+    } else if (extends_next) {
+        next->first_object_block_index--;
+        next->first_block--;
+        next->num_blocks++;
+    } else {
+        if (lookup_table->num_extents == lookup_table->max_extents) {
+            return false;
+        }
+        memmove(&extents[i + 1], &extents[i], (lookup_table->num_extents - i) * sizeof(lookup_extent_t));
+        extents[i] = (lookup_extent_t) {
+            .object_id = object_id,
+            .first_object_block_index = object_block_index,
+            .num_blocks = 1,
+            .first_block = block,
+        };
+        lookup_table->num_extents++;
+    }
+    return true;
+}
+
+//! Removes a block from the extent table (its value must not have been changed yet), returning false if the extent
+//! needed to be split but there's no room to do so
+static bool extent_remove(lookup_table_t* lookup_table, afs_block_t block) {
+    const afs_object_id_t object_id = get_object_id(lookup_table, block);
+    const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_table->values[block]);
+    lookup_extent_t* extents = lookup_table->extents;
+    const uint32_t i = extent_upper_bound(lookup_table, object_id, object_block_index);
+    AFS_ASSERT(i > 0 && extent_contains(&extents[i - 1], object_id, object_block_index));
+    lookup_extent_t* extent = &extents[i - 1];
+    const uint16_t offset = object_block_index - extent->first_object_block_index;
+    AFS_ASSERT_EQ(extent->first_block + offset, block);
+    if (extent->num_blocks == 1) {
+        memmove(extent, extent + 1, (lookup_table->num_extents - i) * sizeof(lookup_extent_t));
+        lookup_table->num_extents--;
+    } else if (offset == 0) {
+        extent->first_object_block_index++;
+        extent->first_block++;
+        extent->num_blocks--;
+    } else if (offset == extent->num_blocks - 1) {
+        extent->num_blocks--;
+    } else {
+        // Split the extent around the block
+        if (lookup_table->num_extents == lookup_table->max_extents) {
+            return false;
+        }
+        memmove(&extents[i + 1], &extents[i], (lookup_table->num_extents - i) * sizeof(lookup_extent_t));
+        extents[i] = (lookup_extent_t) {
+            .object_id = object_id,
+            .first_object_block_index = object_block_index + 1,
+            .num_blocks = extent->num_blocks - offset - 1,
+            .first_block = block + 1,
+        };
+        extent->num_blocks = offset;
+        lookup_table->num_extents++;
+    }
+    return true;
+}
+
+static void extent_fall_back_to_index(lookup_table_t* lookup_table) {
+    // The blocks are too fragmented for the extent table, so move all the blocks in it into the hash index (which is
+    // kept empty while the extent table is being used) and use that from now on
+    AFS_LOG_DEBUG("Falling back to the hash index (num_extents=%"PRIu32")", lookup_table->num_extents);
+    lookup_table->use_extents = false;
+    for (uint32_t i = 0; i < lookup_table->num_extents; i++) {
+        const lookup_extent_t* extent = &lookup_table->extents[i];
+        for (uint16_t j = 0; j < extent->num_blocks; j++) {
+            index_insert(lookup_table, extent->first_block + j);
+        }
+    }
+    lookup_table->num_extents = 0;
+}
+
+static void add_to_index(lookup_table_t* lookup_table, afs_block_t block) {
+    if (lookup_table->use_extents) {
+        if (extent_insert(lookup_table, block)) {
+            return;
+        }
+        extent_fall_back_to_index(lookup_table);
+    }
+    index_insert(lookup_table, block);
+}
+
+static void remove_from_index(lookup_table_t* lookup_table, afs_block_t block) {
+    if (lookup_table->use_extents) {
+        if (extent_remove(lookup_table, block)) {
+            return;
+        }
+        extent_fall_back_to_index(lookup_table);
+    }
+    index_remove(lookup_table, block);
+}
+
+static afs_block_t find_block(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index) {
+    if (lookup_table->use_extents) {
+        return extent_find(lookup_table, object_id, object_block_index);
+    }
+    return index_find(lookup_table, object_id, object_block_index);
+}
+
+static bool is_object_id_available(const afs_impl_t* afs, afs_object_id_t object_id) {
+    // Objects which are being created won't be in the lookup table until they're written
+    return is_object_id_valid(object_id) && find_block(&afs->lookup_table, object_id, 0) == INVALID_BLOCK &&
+        !open_object_list_contains(afs, object_id) && !is_deleted_object_id_high(&afs->lookup_table, OBJECT_ID_HIGH(object_id));
+}
+
+static void free_list_append(lookup_table_t* lookup_table, afs_block_t block) {
+    const uint16_t state = LOOKUP_TABLE_GET_BLOCK_STATE(lookup_table->values[block]);
+    AFS_ASSERT(state < LOOKUP_TABLE_NUM_FREE_STATES);
+    free_list_t* free_list = &lookup_table->free_lists[state];
+    lookup_table->free_list_next[block] = INVALID_BLOCK;
+    if (free_list->tail == INVALID_BLOCK) {
+        free_list->head = block;
+    } else {
+        lookup_table->free_list_next[free_list->tail] = block;
+    }
+    free_list->tail = block;
+    free_list->count++;
+    lookup_table->num_free++;
+}
+
+static afs_block_t free_list_pop(lookup_table_t* lookup_table, uint16_t state) {
+    free_list_t* free_list = &lookup_table->free_lists[state];
+    const afs_block_t block = free_list->head;
+    if (block == INVALID_BLOCK) {
+        return INVALID_BLOCK;
+    }
+    free_list->head = lookup_table->free_list_next[block];
+    if (free_list->head == INVALID_BLOCK) {
+        free_list->tail = INVALID_BLOCK;
+    }
+    free_list->count--;
+    lookup_table->num_free--;
+    return block;
+}
+
+static void reset_indexes(lookup_table_t* lookup_table) {
+    memset(lookup_table->index, 0xff, INDEX_NUM_SLOTS(lookup_table->num_blocks) * sizeof(afs_block_t));
+    lookup_table->num_extents = 0;
+    lookup_table->use_extents = lookup_table->max_extents > 0;
+    for (uint16_t i = 0; i < LOOKUP_TABLE_NUM_FREE_STATES; i++) {
+        lookup_table->free_lists[i] = (free_list_t) {
+            .head = INVALID_BLOCK,
+            .tail = INVALID_BLOCK,
+        };
+    }
+    lookup_table->num_free = 0;
+}
+
+static void rebuild_indexes(lookup_table_t* lookup_table) {
+    reset_indexes(lookup_table);
+    for (afs_block_t i = 0; i < lookup_table->num_blocks; i++) {
+        if (is_in_use(lookup_table->values[i])) {
+            add_to_index(lookup_table, i);
+        } else {
+            free_list_append(lookup_table, i);
+        }
+    }
+}
+
+//! Sets the lookup table value for a block (free blocks must have already been removed from their free list)
+static inline void set_value(lookup_table_t* lookup_table, afs_block_t block, afs_object_id_t object_id, uint16_t object_block_index) {
+    const uint32_t prev_value = lookup_table->values[block];
+    if (is_in_use(prev_value)) {
+        remove_from_index(lookup_table, block);
+    }
     lookup_table->values[block] = LOOKUP_TABLE_VALUE(object_id, object_block_index);
+    lookup_table->num_changes++;
+    if (object_id != INVALID_OBJECT_ID) {
+        lookup_table->object_id_high[block] = OBJECT_ID_HIGH(object_id);
+        add_to_index(lookup_table, block);
+    } else {
+        free_list_append(lookup_table, block);
+    }
 }
 
-static inline void set_free(lookup_table_t* lookup_table, uint16_t block, uint16_t state) {
+static inline void set_free(lookup_table_t* lookup_table, afs_block_t block, uint16_t state) {
     set_value(lookup_table, block, INVALID_OBJECT_ID, state);
 }
 
-static inline void set_is_v2(lookup_table_t* lookup_table, uint16_t block, bool value) {
-    lookup_table->version_bitmap[block / sizeof(uint8_t)] |= (value ? 1 : 0) << (block & 0x7);
+static inline void set_is_v2(lookup_table_t* lookup_table, afs_block_t block, bool value) {
+    if (value) {
+        lookup_table->version_bitmap[block / 8] |= 1 << (block & 0x7);
+    } else {
+        lookup_table->version_bitmap[block / 8] &= ~(1 << (block & 0x7));
+    }
 }
 
-static inline bool get_is_v2(const lookup_table_t* lookup_table, uint16_t block) {
-    return lookup_table->version_bitmap[block / sizeof(uint8_t)] & (1 << (block & 0x07));
+static inline bool get_is_v2(const lookup_table_t* lookup_table, afs_block_t block) {
+    return lookup_table->version_bitmap[block / 8] & (1 << (block & 0x07));
 }
 
-static uint32_t get_object_data_from_cache(cache_t* cache, uint8_t* stream) {
+static uint32_t get_object_data_from_cache(cache_t* cache, uint32_t header_length, uint8_t* stream) {
     AFS_ASSERT_EQ(cache->length, cache->size);
     AFS_ASSERT_EQ(cache->position.offset, 0);
 
-    uint32_t read_offset = sizeof(block_header_t);
+    uint32_t read_offset = header_length;
     *stream = AFS_WILDCARD_STREAM;
     uint32_t data_length = 0;
     while (true) {
@@ -74,7 +514,7 @@ static uint32_t get_object_data_from_cache(cache_t* cache, uint8_t* stream) {
     return data_length;
 }
 
-static void populate_for_block(lookup_table_t* lookup_table, storage_t* storage, uint16_t block, afs_object_found_callback_t object_found_callback) {
+static void populate_for_block(lookup_table_t* lookup_table, storage_t* storage, afs_block_t block, afs_object_found_callback_t object_found_callback) {
     position_t position = {
         .block = block,
         .offset = 0,
@@ -83,266 +523,429 @@ static void populate_for_block(lookup_table_t* lookup_table, storage_t* storage,
     storage_read_block_header(storage, &position, &header);
     bool is_v2 = false;
     if (util_is_block_header_valid(&header, &is_v2)) {
-        set_value(lookup_table, block, header.object_id, header.object_block_index);
+        const afs_object_id_t object_id = util_get_block_header_object_id(&header);
+        lookup_table->values[block] = LOOKUP_TABLE_VALUE(object_id, header.object_block_index);
+        lookup_table->object_id_high[block] = OBJECT_ID_HIGH(object_id);
         if (header.object_block_index == 0 && object_found_callback) {
             // Call the object found callback
             cache_t* cache = &storage->cache;
             AFS_ASSERT_EQ(cache->position.block, block);
             uint8_t stream;
-            const uint32_t data_length = get_object_data_from_cache(cache, &stream);
-            object_found_callback(header.object_id, stream, cache->buffer, data_length);
+            const uint32_t data_length = get_object_data_from_cache(cache, util_get_block_header_length(&header), &stream);
+            object_found_callback(object_id, stream, cache->buffer, data_length);
         }
     } else {
         // Check if the header is completely empty as that might be an indication that the block is erased, so we'll
         // use this block before we use other ones that might have more-expensive erase operations
         const block_header_t EMPTY_BLOCK_HEADER = {};
         const bool maybe_erased = !memcmp(&header, &EMPTY_BLOCK_HEADER, sizeof(header));
-        set_free(lookup_table, block, maybe_erased ? LOOKUP_TABLE_BLOCK_STATE_MAYBE_ERASED : LOOKUP_TABLE_BLOCK_STATE_UNKNOWN);
+        const uint16_t state = maybe_erased ? LOOKUP_TABLE_BLOCK_STATE_MAYBE_ERASED : LOOKUP_TABLE_BLOCK_STATE_UNKNOWN;
+        lookup_table->values[block] = LOOKUP_TABLE_FREE_BLOCK_VALUE(state);
     }
     set_is_v2(lookup_table, block, is_v2);
-    // Use the lookup value to generate some randomness in our seed
-    lookup_table->object_id_seed ^= lookup_table->values[block];
 }
 
-static bool is_object_deleted(const lookup_table_t* lookup_table, uint16_t object_id) {
-    const uint32_t search_lookup_value = LOOKUP_TABLE_VALUE(object_id, 0);
-    for (uint32_t j = 0; j < lookup_table->num_blocks; j++) {
-        if (lookup_table->values[j] == search_lookup_value) {
-            return true;
+void lookup_table_init(lookup_table_t* lookup_table, afs_block_t num_blocks, void* buffer, void* extent_buffer, uint32_t extent_buffer_size) {
+    // The buffer is laid out as the values, the index, the free list links, the upper halves of the object IDs, the
+    // object block counts and then the version bitmap
+    uint8_t* buffer_ptr = buffer;
+    *lookup_table = (lookup_table_t) {
+        .num_blocks = num_blocks,
+        .values = (uint32_t*)buffer_ptr,
+        .extents = extent_buffer,
+        .max_extents = extent_buffer_size / sizeof(lookup_extent_t),
+    };
+    buffer_ptr += num_blocks * sizeof(uint32_t);
+    lookup_table->index = (afs_block_t*)buffer_ptr;
+    buffer_ptr += INDEX_NUM_SLOTS(num_blocks) * sizeof(afs_block_t);
+    lookup_table->free_list_next = (afs_block_t*)buffer_ptr;
+    buffer_ptr += num_blocks * sizeof(afs_block_t);
+    lookup_table->object_id_high = (uint16_t*)buffer_ptr;
+    buffer_ptr += num_blocks * sizeof(uint16_t);
+    lookup_table->object_num_blocks = (uint16_t*)buffer_ptr;
+    buffer_ptr += num_blocks * sizeof(uint16_t);
+    lookup_table->version_bitmap = buffer_ptr;
+    buffer_ptr += (num_blocks + 7) / 8;
+    AFS_ASSERT_EQ(buffer_ptr - (uint8_t*)buffer, AFS_LOOKUP_TABLE_SIZE(num_blocks));
+
+    // Start with the index and free lists empty until the lookup table is populated
+    memset(lookup_table->values, 0, num_blocks * sizeof(uint32_t));
+    memset(lookup_table->object_id_high, 0, num_blocks * sizeof(uint16_t));
+    memset(lookup_table->version_bitmap, 0, (num_blocks + 7) / 8);
+    reset_indexes(lookup_table);
+}
+
+static bool should_populate_block(const afs_impl_t* afs, afs_block_t block) {
+    if (!afs->mount.is_checkpoint_loaded) {
+        return true;
+    }
+    // Blocks which were in use when the checkpoint was written can't have changed since then (deleting objects
+    // invalidates the checkpoint), so we only need to read them in order to call the object found callback
+    const uint32_t value = afs->lookup_table.values[block];
+    return !is_in_use(value) || (LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value) == 0 && afs->mount.object_found);
+}
+
+static void populate_batched(afs_impl_t* afs, uint8_t* buffer, uint32_t batch_size) {
+    lookup_table_t* lookup_table = &afs->lookup_table;
+    cache_t* cache = &afs->storage.cache;
+    // The buffer contains the data for each read followed by the read requests
+    afs_read_request_t* requests = (afs_read_request_t*)&buffer[batch_size * cache->size];
+    afs_block_t block = 0;
+    while (block < lookup_table->num_blocks) {
+        // Queue up reads of the first sector of the next batch of blocks
+        uint32_t num_requests = 0;
+        for (; block < lookup_table->num_blocks && num_requests < batch_size; block++) {
+            if (!should_populate_block(afs, block)) {
+                continue;
+            }
+            requests[num_requests] = (afs_read_request_t) {
+                .buf = &buffer[num_requests * cache->size],
+                .block = block,
+                .offset = 0,
+                .length = cache->size,
+            };
+            num_requests++;
+        }
+        if (!num_requests) {
+            break;
+        }
+        afs->storage_config.read_multi(requests, num_requests);
+
+        // Populate each block from its data by loading it into the cache
+        for (uint32_t i = 0; i < num_requests; i++) {
+            memcpy(cache->buffer, requests[i].buf, cache->size);
+            cache->position = (position_t) {
+                .block = requests[i].block,
+                .offset = 0,
+            };
+            cache->length = cache->size;
+            populate_for_block(lookup_table, &afs->storage, requests[i].block, afs->mount.object_found);
         }
     }
-    return false;
 }
 
-void lookup_table_populate(afs_impl_t* afs, afs_object_found_callback_t object_found_callback) {
-    // Populate our lookup table from the storage
-    for (uint16_t block = 0; block < afs->storage_config.num_blocks; block++) {
-        populate_for_block(&afs->lookup_table, &afs->storage, block, object_found_callback);
+void lookup_table_populate(afs_impl_t* afs, void* mount_buffer, uint32_t mount_buffer_size) {
+    // Populate our lookup table from the storage, batching the reads if possible
+    const uint32_t batch_size = afs->storage_config.read_multi ?
+        mount_buffer_size / (afs->storage.cache.size + sizeof(afs_read_request_t)) : 0;
+    if (batch_size > 1) {
+        populate_batched(afs, mount_buffer, batch_size);
+    } else {
+        lookup_table_populate_range(afs, &afs->storage, 0, afs->storage_config.num_blocks);
     }
+}
+
+void lookup_table_populate_range(afs_impl_t* afs, storage_t* storage, afs_block_t first_block, afs_block_t num_blocks) {
+    AFS_ASSERT((uint64_t)first_block + num_blocks <= afs->lookup_table.num_blocks);
+    for (afs_block_t block = first_block; block < first_block + num_blocks; block++) {
+        if (should_populate_block(afs, block)) {
+            populate_for_block(&afs->lookup_table, storage, block, afs->mount.object_found);
+        }
+    }
+}
 
-    // Remove any entries from our lookup table for deleted objects
-    for (uint16_t i = 0; i < afs->storage_config.num_blocks; i++) {
+void lookup_table_populate_finish(afs_impl_t* afs) {
+    rebuild_indexes(&afs->lookup_table);
+    memset(afs->lookup_table.object_num_blocks, 0, afs->lookup_table.num_blocks * sizeof(uint16_t));
+
+    // Remove any entries from our lookup table for deleted objects (i.e. objects without a first block) and count the
+    // blocks of the remaining objects, which is a single pass since the index lets us find the first block of each
+    // object in constant time
+    for (afs_block_t i = 0; i < afs->storage_config.num_blocks; i++) {
         const uint32_t value = afs->lookup_table.values[i];
-        const uint16_t object_id = LOOKUP_TABLE_GET_OBJECT_ID(value);
-        if (object_id == INVALID_OBJECT_ID) {
+        // Use the lookup value to generate some randomness in our seed
+        afs->lookup_table.object_id_seed ^= value;
+        if (!is_in_use(value)) {
             // Free block
             continue;
         }
+        const afs_object_id_t object_id = get_object_id(&afs->lookup_table, i);
         const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value);
-        if (object_block_index == 0) {
-            // This is the first block, so the object is valid
-            continue;
-        }
-        if (!is_object_deleted(&afs->lookup_table, object_id)) {
-            AFS_LOG_DEBUG("Removing deleted object from lookup table (object_id=%u, object_block_index=%u)", object_id, object_block_index);
+        const afs_block_t first_block = find_block(&afs->lookup_table, object_id, 0);
+        if (first_block == INVALID_BLOCK) {
+            AFS_LOG_DEBUG("Removing deleted object from lookup table (object_id=%"PRIu32", object_block_index=%u)", object_id, object_block_index);
             set_free(&afs->lookup_table, i, LOOKUP_TABLE_BLOCK_STATE_GARBAGE);
+            continue;
         }
+        uint16_t* num_blocks = &afs->lookup_table.object_num_blocks[first_block];
+        *num_blocks = MAX_VAL(*num_blocks, object_block_index + 1);
     }
 }
 
-uint32_t lookup_table_get_block(const lookup_table_t* lookup_table, uint16_t object_id, uint16_t object_block_index) {
-    const uint32_t expected_lookup_value = LOOKUP_TABLE_VALUE(object_id, object_block_index);
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        if (lookup_table->values[i] == expected_lookup_value) {
-            return i;
-        }
+uint32_t lookup_table_get_checkpoint_length(const lookup_table_t* lookup_table) {
+    return lookup_table->num_blocks * (sizeof(uint32_t) + sizeof(uint16_t)) + (lookup_table->num_blocks + 7) / 8;
+}
+
+static uint32_t get_checkpoint_value(const afs_impl_t* afs, afs_block_t block, uint16_t* object_id_high) {
+    // Blocks of objects which are still being written might not have made it to the storage yet, so record them as
+    // being in an unknown state so they get read from the storage when the checkpoint is loaded
+    const uint32_t value = afs->lookup_table.values[block];
+    *object_id_high = 0;
+    if (!is_in_use(value)) {
+        return value;
+    } else if (open_object_list_is_writing(afs, get_object_id(&afs->lookup_table, block))) {
+        return LOOKUP_TABLE_FREE_BLOCK_VALUE(LOOKUP_TABLE_BLOCK_STATE_UNKNOWN);
     }
-    return INVALID_BLOCK;
+    *object_id_high = afs->lookup_table.object_id_high[block];
+    return value;
 }
 
-uint16_t lookup_table_get_num_blocks(const lookup_table_t* lookup_table, uint16_t object_id) {
-    uint16_t num_blocks = 0;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) == object_id) {
-            num_blocks = MAX_VAL(num_blocks, LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value) + 1);
+void lookup_table_get_checkpoint_data(const afs_impl_t* afs, uint32_t offset, uint8_t* buf, uint32_t length) {
+    // The checkpoint data is the lookup table values followed by the upper halves of the object IDs, the version bitmap
+    // and then padding
+    const lookup_table_t* lookup_table = &afs->lookup_table;
+    const uint32_t values_length = lookup_table->num_blocks * sizeof(uint32_t);
+    const uint32_t object_id_high_length = lookup_table->num_blocks * sizeof(uint16_t);
+    const uint32_t bitmap_length = (lookup_table->num_blocks + 7) / 8;
+    while (length) {
+        uint32_t copy_length;
+        if (offset < values_length) {
+            uint16_t object_id_high;
+            const uint32_t value = get_checkpoint_value(afs, offset / sizeof(uint32_t), &object_id_high);
+            const uint32_t value_offset = offset % sizeof(uint32_t);
+            copy_length = MIN_VAL((uint32_t)sizeof(value) - value_offset, length);
+            memcpy(buf, (const uint8_t*)&value + value_offset, copy_length);
+        } else if (offset < values_length + object_id_high_length) {
+            uint16_t object_id_high;
+            get_checkpoint_value(afs, (offset - values_length) / sizeof(uint16_t), &object_id_high);
+            const uint32_t value_offset = (offset - values_length) % sizeof(uint16_t);
+            copy_length = MIN_VAL((uint32_t)sizeof(object_id_high) - value_offset, length);
+            memcpy(buf, (const uint8_t*)&object_id_high + value_offset, copy_length);
+        } else if (offset < values_length + object_id_high_length + bitmap_length) {
+            const uint32_t bitmap_offset = offset - values_length - object_id_high_length;
+            copy_length = MIN_VAL(bitmap_length - bitmap_offset, length);
+            memcpy(buf, &lookup_table->version_bitmap[bitmap_offset], copy_length);
+        } else {
+            copy_length = length;
+            memset(buf, 0, copy_length);
         }
+        offset += copy_length;
+        buf += copy_length;
+        length -= copy_length;
     }
-    return num_blocks;
 }
 
-uint16_t lookup_table_get_last_block(const lookup_table_t* lookup_table, uint16_t object_id) {
-    uint16_t last_block = INVALID_BLOCK;
-    uint16_t max_block_index = 0;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) != object_id) {
-            continue;
-        }
-        const uint16_t block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value);
-        if (last_block == INVALID_BLOCK || block_index > max_block_index) {
-            last_block = i;
-            max_block_index = block_index;
-        }
+void lookup_table_set_checkpoint_data(lookup_table_t* lookup_table, uint32_t offset, const uint8_t* buf, uint32_t length) {
+    const uint32_t values_length = lookup_table->num_blocks * sizeof(uint32_t);
+    const uint32_t object_id_high_length = lookup_table->num_blocks * sizeof(uint16_t);
+    const uint32_t bitmap_length = (lookup_table->num_blocks + 7) / 8;
+    AFS_ASSERT(offset + length <= values_length + object_id_high_length + bitmap_length);
+    if (offset < values_length) {
+        const uint32_t copy_length = MIN_VAL(values_length - offset, length);
+        memcpy((uint8_t*)lookup_table->values + offset, buf, copy_length);
+        offset += copy_length;
+        buf += copy_length;
+        length -= copy_length;
+    }
+    if (length && offset < values_length + object_id_high_length) {
+        const uint32_t copy_length = MIN_VAL(values_length + object_id_high_length - offset, length);
+        memcpy((uint8_t*)lookup_table->object_id_high + offset - values_length, buf, copy_length);
+        offset += copy_length;
+        buf += copy_length;
+        length -= copy_length;
     }
-    return last_block;
+    if (length) {
+        memcpy(&lookup_table->version_bitmap[offset - values_length - object_id_high_length], buf, length);
+    }
+}
+
+afs_block_t lookup_table_get_block(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index) {
+    return find_block(lookup_table, object_id, object_block_index);
 }
 
-bool lookup_table_get_is_v2(const lookup_table_t* lookup_table, uint16_t block) {
+uint16_t lookup_table_get_num_blocks(const lookup_table_t* lookup_table, afs_object_id_t object_id) {
+    const afs_block_t first_block = find_block(lookup_table, object_id, 0);
+    return first_block == INVALID_BLOCK ? 0 : lookup_table->object_num_blocks[first_block];
+}
+
+afs_block_t lookup_table_get_last_block(const lookup_table_t* lookup_table, afs_object_id_t object_id) {
+    const uint16_t num_blocks = lookup_table_get_num_blocks(lookup_table, object_id);
+    return num_blocks ? find_block(lookup_table, object_id, num_blocks - 1) : INVALID_BLOCK;
+}
+
+bool lookup_table_get_is_v2(const lookup_table_t* lookup_table, afs_block_t block) {
     return get_is_v2(lookup_table, block);
 }
 
-uint16_t lookup_table_get_next_object_id(lookup_table_t* lookup_table) {
-    // In the worst case, this function is O(num_blocks^2), but statistically, there is a num_blocks / 2^16 chance that
-    // we find a valid object ID with each loop, so in practice it should be very fast.
-    while (true) {
-        // Very simple psuedo-random number generator which uniformly generates 16-bit values
+afs_object_id_t lookup_table_get_next_object_id(afs_impl_t* afs) {
+    lookup_table_t* lookup_table = &afs->lookup_table;
+    // Try a few psuedo-random object IDs first, which will almost always find an unused one as there's at most a
+    // num_blocks / 2^32 chance that each one is in use by an object
+    afs_object_id_t object_id = INVALID_OBJECT_ID;
+    for (uint16_t i = 0; i < OBJECT_ID_MAX_RANDOM_ATTEMPTS; i++) {
+        // Very simple psuedo-random number generator, with the upper bits folded into the less-random lower bits
         lookup_table->object_id_seed = lookup_table->object_id_seed * 1664525 + 1013904223;
-        const uint16_t object_id = (uint16_t)lookup_table->object_id_seed;
-        if (object_id == INVALID_OBJECT_ID) {
-            continue;
-        }
-        bool in_use = false;
-        for (uint16_t j = 0; j < lookup_table->num_blocks; j++) {
-            if (object_id == LOOKUP_TABLE_GET_OBJECT_ID(lookup_table->values[j])) {
-                in_use = true;
-                break;
-            }
-        }
-        if (!in_use) {
+        object_id = lookup_table->object_id_seed ^ (lookup_table->object_id_seed >> 16);
+        if (is_object_id_available(afs, object_id)) {
             return object_id;
         }
     }
+    // Otherwise, step through the object IDs from the last one we tried, skipping over all the ones which share the
+    // upper 16 bits of a deleted object which hasn't been erased yet (so this is bounded by the number of objects)
+    while (!is_object_id_available(afs, object_id)) {
+        if (is_deleted_object_id_high(lookup_table, OBJECT_ID_HIGH(object_id))) {
+            object_id = (object_id | 0xffff) + 1;
+        } else {
+            object_id++;
+        }
+    }
+    return object_id;
 }
 
-uint16_t lookup_table_iter_get_next_object(const lookup_table_t* lookup_table, uint16_t *block) {
-    for (uint16_t i = *block; i < lookup_table->num_blocks; i++) {
-        const uint32_t lookup_value = lookup_table->values[i];
-        const uint16_t object_id = LOOKUP_TABLE_GET_OBJECT_ID(lookup_value);
-        const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_value);
-        if (object_id == INVALID_OBJECT_ID || object_block_index != 0) {
-            // This block is free or not the first block in the object
-            continue;
-        }
-        *block = i + 1;
-        return object_id;
+afs_object_id_t lookup_table_iter_get_next_object(const lookup_table_t* lookup_table, afs_block_t *block) {
+    const afs_block_t first_block = find_next_first_block(lookup_table, *block);
+    if (first_block == INVALID_BLOCK) {
+        return INVALID_OBJECT_ID;
     }
-    return INVALID_OBJECT_ID;
+    *block = first_block + 1;
+    return get_object_id(lookup_table, first_block);
 }
 
-uint16_t lookup_table_delete_object(lookup_table_t* lookup_table, uint16_t object_id) {
-    uint16_t first_block = INVALID_BLOCK;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) != object_id) {
-            continue;
-        }
-        const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value);
-        if (object_block_index == 0) {
-            first_block = i;
+afs_block_t lookup_table_delete_object(lookup_table_t* lookup_table, afs_object_id_t object_id, bool defer_erase) {
+    // Look up each of the object's blocks via the index rather than scanning the whole table (the block count must be
+    // read before the first block is freed)
+    const afs_block_t first_block = find_block(lookup_table, object_id, 0);
+    AFS_ASSERT_NOT_EQ(first_block, INVALID_BLOCK);
+    const uint16_t num_blocks = lookup_table->object_num_blocks[first_block];
+    for (uint32_t object_block_index = 0; object_block_index < num_blocks; object_block_index++) {
+        // Keep looking up the same object block index in case there are duplicate entries for it
+        while (true) {
+            const afs_block_t block = find_block(lookup_table, object_id, object_block_index);
+            if (block == INVALID_BLOCK) {
+                break;
+            }
+            AFS_LOG_DEBUG("Clearing lookup table for block (block=%"PRI_BLOCK", object_block_index=%"PRIu32")", block, object_block_index);
+            uint16_t state = LOOKUP_TABLE_BLOCK_STATE_GARBAGE;
+            if (object_block_index == 0) {
+                state = defer_erase ? LOOKUP_TABLE_BLOCK_STATE_DELETED : LOOKUP_TABLE_BLOCK_STATE_ERASED;
+            }
+            set_free(lookup_table, block, state);
         }
-        AFS_LOG_DEBUG("Clearing lookup table for block (block=%u, object_block_index=%u)", object_id, object_block_index);
-        set_free(lookup_table, i, object_block_index == 0 ? LOOKUP_TABLE_BLOCK_STATE_ERASED : LOOKUP_TABLE_BLOCK_STATE_GARBAGE);
     }
-    AFS_ASSERT_NOT_EQ(first_block, INVALID_BLOCK);
     return first_block;
 }
 
-uint16_t lookup_table_get_total_num_blocks(const lookup_table_t* lookup_table) {
-    uint16_t blocks_used = 0;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        if (LOOKUP_TABLE_GET_OBJECT_ID(lookup_table->values[i]) != INVALID_OBJECT_ID) {
-            blocks_used++;
-        }
+bool lookup_table_delete_first_block(lookup_table_t* lookup_table, afs_block_t block) {
+    if (block >= lookup_table->num_blocks) {
+        return false;
+    }
+    const uint32_t value = lookup_table->values[block];
+    if (!is_in_use(value) || LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value) != 0) {
+        // The block has already been erased
+        return false;
     }
-    return blocks_used;
+    lookup_table_delete_object(lookup_table, get_object_id(lookup_table, block), true);
+    return true;
+}
+
+afs_block_t lookup_table_get_total_num_blocks(const lookup_table_t* lookup_table) {
+    // Every block is either in use or in one of the free lists
+    return lookup_table->num_blocks - lookup_table->num_free;
 }
 
 bool lookup_table_is_full(const lookup_table_t* lookup_table) {
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        if (LOOKUP_TABLE_GET_OBJECT_ID(lookup_table->values[i]) == INVALID_OBJECT_ID) {
-            return false;
-        }
-    }
-    return true;
+    return !lookup_table->num_free;
 }
 
-uint16_t lookup_table_acquire_block(lookup_table_t* lookup_table, uint16_t object_id, uint16_t object_block_index, bool* is_erased) {
-    // Look for a block which is ideally already erased
-    // Find the first free / best block from our lookup table (the underlying storage handles wear leveling for us)
-    uint16_t best_block = INVALID_BLOCK;
-    uint16_t best_block_state = UINT16_MAX;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) == INVALID_OBJECT_ID) {
-            const uint16_t state = LOOKUP_TABLE_GET_BLOCK_STATE(value);
-            if (state < best_block_state) {
-                best_block = i;
-                best_block_state = state;
-            }
-            if (state == LOOKUP_TABLE_BLOCK_STATE_ERASED) {
-                break;
-            }
+void lookup_table_get_usage(const lookup_table_t* lookup_table, afs_usage_t* usage) {
+    const free_list_t* free_lists = lookup_table->free_lists;
+    *usage = (afs_usage_t) {
+        .num_blocks = lookup_table->num_blocks,
+        .num_used_blocks = lookup_table_get_total_num_blocks(lookup_table),
+        .num_free_blocks = lookup_table->num_free,
+        .num_erased_blocks = free_lists[LOOKUP_TABLE_BLOCK_STATE_ERASED].count,
+        .num_garbage_blocks = free_lists[LOOKUP_TABLE_BLOCK_STATE_UNKNOWN].count +
+            free_lists[LOOKUP_TABLE_BLOCK_STATE_GARBAGE].count + free_lists[LOOKUP_TABLE_BLOCK_STATE_DELETED].count,
+    };
+}
+
+afs_block_t lookup_table_acquire_block(lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index, bool* is_erased) {
+    // Take the first block from the best free list, ideally one which is already erased (the underlying storage
+    // handles wear leveling for us)
+    for (uint16_t state = 0; state < LOOKUP_TABLE_BLOCK_STATE_DELETED; state++) {
+        const afs_block_t block = free_list_pop(lookup_table, state);
+        if (block == INVALID_BLOCK) {
+            continue;
+        }
+        set_value(lookup_table, block, object_id, object_block_index);
+        set_is_v2(lookup_table, block, true);
+        *is_erased = state == LOOKUP_TABLE_BLOCK_STATE_ERASED;
+        // Update the number of blocks in the object
+        const afs_block_t first_block = object_block_index == 0 ? block : find_block(lookup_table, object_id, 0);
+        if (first_block != INVALID_BLOCK) {
+            uint16_t* num_blocks = &lookup_table->object_num_blocks[first_block];
+            *num_blocks = object_block_index == 0 ? 1 : MAX_VAL(*num_blocks, object_block_index + 1);
         }
+        return block;
     }
+    return INVALID_BLOCK;
+}
 
-    if (best_block == INVALID_BLOCK) {
+afs_block_t lookup_table_wipe_next_in_use(lookup_table_t* lookup_table, afs_block_t start_block, bool* should_erase) {
+    const afs_block_t block = find_next_in_use(lookup_table, start_block);
+    if (block == INVALID_BLOCK) {
         return INVALID_BLOCK;
     }
+    const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_table->values[block]);
+    // Should always erase the first block
+    *should_erase = object_block_index == 0 || *should_erase;
+    if (*should_erase) {
+        AFS_LOG_DEBUG("Erasing block (block=%"PRI_BLOCK", object_id=%"PRIu32", object_block_index%u)", block, get_object_id(lookup_table, block), object_block_index);
+    }
+    set_free(lookup_table, block, *should_erase ? LOOKUP_TABLE_BLOCK_STATE_ERASED : LOOKUP_TABLE_BLOCK_STATE_GARBAGE);
+    return block;
+}
 
-    lookup_table->values[best_block] = LOOKUP_TABLE_VALUE(object_id, object_block_index);
-    set_is_v2(lookup_table, best_block, true);
-    *is_erased = best_block_state == LOOKUP_TABLE_BLOCK_STATE_ERASED;
-    return best_block;
+afs_block_t lookup_table_get_num_erased(const lookup_table_t* lookup_table) {
+    return lookup_table->free_lists[LOOKUP_TABLE_BLOCK_STATE_ERASED].count;
 }
 
-uint16_t lookup_table_wipe_next_in_use(lookup_table_t* lookup_table, uint16_t start_block, bool* should_erase) {
-    for (uint16_t i = start_block; i < lookup_table->num_blocks; i++) {
-        const uint32_t lookup_value = lookup_table->values[i];
-        const uint16_t object_id = LOOKUP_TABLE_GET_OBJECT_ID(lookup_value);
-        if (object_id == INVALID_OBJECT_ID) {
-            // This block is free
+afs_block_t lookup_table_get_next_pending_erase(lookup_table_t* lookup_table) {
+    for (uint16_t state = 0; state < LOOKUP_TABLE_BLOCK_STATE_DELETED; state++) {
+        if (state == LOOKUP_TABLE_BLOCK_STATE_ERASED) {
             continue;
         }
-        const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_value);
-        // Should always erase the first block
-        *should_erase = object_block_index == 0 || *should_erase;
-        if (*should_erase) {
-            AFS_LOG_DEBUG("Erasing block (block=%u, object_id=%u, object_block_index%u)", i, object_id, object_block_index);
+        const afs_block_t block = free_list_pop(lookup_table, state);
+        if (block != INVALID_BLOCK) {
+            set_free(lookup_table, block, LOOKUP_TABLE_BLOCK_STATE_ERASED);
+            return block;
         }
-        set_free(lookup_table, i, *should_erase ? LOOKUP_TABLE_BLOCK_STATE_ERASED : LOOKUP_TABLE_BLOCK_STATE_GARBAGE);
-        return i;
     }
     return INVALID_BLOCK;
 }
 
-uint16_t lookup_table_get_num_erased(const lookup_table_t* lookup_table) {
-    uint16_t num_erased = 0;
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        if (lookup_table->values[i] == LOOKUP_TABLE_FREE_BLOCK_VALUE(LOOKUP_TABLE_BLOCK_STATE_ERASED)) {
-            num_erased++;
-        }
+afs_block_t lookup_table_get_num_deleted(const lookup_table_t* lookup_table) {
+    return lookup_table->free_lists[LOOKUP_TABLE_BLOCK_STATE_DELETED].count;
+}
+
+afs_block_t lookup_table_get_next_deleted(const lookup_table_t* lookup_table, afs_block_t prev_block) {
+    if (prev_block == INVALID_BLOCK) {
+        return lookup_table->free_lists[LOOKUP_TABLE_BLOCK_STATE_DELETED].head;
     }
-    return num_erased;
+    return lookup_table->free_list_next[prev_block];
 }
 
-uint16_t lookup_table_get_next_pending_erase(lookup_table_t* lookup_table, uint16_t start_block) {
-    for (uint16_t i = start_block; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) == INVALID_OBJECT_ID && LOOKUP_TABLE_GET_BLOCK_STATE(value) != LOOKUP_TABLE_BLOCK_STATE_ERASED) {
-            set_free(lookup_table, i, LOOKUP_TABLE_BLOCK_STATE_ERASED);
-            return i;
-        }
+afs_block_t lookup_table_erase_next_deleted(lookup_table_t* lookup_table) {
+    const afs_block_t block = free_list_pop(lookup_table, LOOKUP_TABLE_BLOCK_STATE_DELETED);
+    if (block != INVALID_BLOCK) {
+        set_free(lookup_table, block, LOOKUP_TABLE_BLOCK_STATE_ERASED);
     }
-    return INVALID_BLOCK;
+    return block;
 }
 
-bool lookup_table_debug_dump_block(const lookup_table_t* lookup_table, uint16_t block) {
+bool lookup_table_debug_dump_block(const lookup_table_t* lookup_table, afs_block_t block) {
     const uint32_t value = lookup_table->values[block];
     if (!value) {
         return false;
     }
-    const uint16_t object_id = LOOKUP_TABLE_GET_OBJECT_ID(value);
+    const afs_object_id_t object_id = get_object_id(lookup_table, block);
     const uint16_t object_block_index = LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value);
-    AFS_LOG_INFO("[%3u]={object_id=%u, object_block_index=%u}", block, object_id, object_block_index);
+    AFS_LOG_INFO("[%3"PRI_BLOCK"]={object_id=%"PRIu32", object_block_index=%u}", block, object_id, object_block_index);
     return true;
 }
 
-void lookup_table_debug_dump_object(const lookup_table_t* lookup_table, uint16_t object_id) {
-    for (uint16_t i = 0; i < lookup_table->num_blocks; i++) {
-        const uint32_t value = lookup_table->values[i];
-        if (LOOKUP_TABLE_GET_OBJECT_ID(value) == object_id) {
-            AFS_LOG_INFO("[%3u]={object_block_index=%u}", i, LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(value));
-        }
+void lookup_table_debug_dump_object(const lookup_table_t* lookup_table, afs_object_id_t object_id) {
+    for (afs_block_t i = find_next_object_block(lookup_table, 0, object_id); i != INVALID_BLOCK; i = find_next_object_block(lookup_table, i + 1, object_id)) {
+        AFS_LOG_INFO("[%3"PRI_BLOCK"]={object_block_index=%u}", i, LOOKUP_TABLE_GET_OBJECT_BLOCK_INDEX(lookup_table->values[i]));
     }
 }
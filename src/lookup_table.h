@@ -2,50 +2,88 @@
 
 #include "impl_types.h"
 
-//! Populates the lookup table by reading through the underlying storage
-void lookup_table_populate(afs_impl_t* afs, afs_object_found_callback_t object_found_callback);
+//! Initializes the lookup table within the provided buffer (of size `AFS_LOOKUP_TABLE_SIZE(num_blocks)`), with an
+//! optional extent buffer used to look up blocks until the storage is too fragmented for it
+void lookup_table_init(lookup_table_t* lookup_table, afs_block_t num_blocks, void* buffer, void* extent_buffer, uint32_t extent_buffer_size);
+
+//! Populates the lookup table by reading through the underlying storage (only reading the blocks which were free if the
+//! lookup table was already loaded from a checkpoint), after which `lookup_table_populate_finish()` must be called
+void lookup_table_populate(afs_impl_t* afs, void* mount_buffer, uint32_t mount_buffer_size);
+
+//! Populates a range of the lookup table by reading through the underlying storage using the specified storage context
+//! (ranges which don't share any bytes of the version bitmap may be populated concurrently)
+void lookup_table_populate_range(afs_impl_t* afs, storage_t* storage, afs_block_t first_block, afs_block_t num_blocks);
+
+//! Finishes populating the lookup table once all the blocks have been populated
+void lookup_table_populate_finish(afs_impl_t* afs);
+
+//! Gets the length of the lookup table data which is stored within a checkpoint
+uint32_t lookup_table_get_checkpoint_length(const lookup_table_t* lookup_table);
+
+//! Gets a range of the lookup table data to store within a checkpoint (zero-padded past the end of the data)
+void lookup_table_get_checkpoint_data(const afs_impl_t* afs, uint32_t offset, uint8_t* buf, uint32_t length);
+
+//! Sets a range of the lookup table data from a checkpoint
+void lookup_table_set_checkpoint_data(lookup_table_t* lookup_table, uint32_t offset, const uint8_t* buf, uint32_t length);
 
 //! Gets the block for a given object_id and object_block_index
-uint32_t lookup_table_get_block(const lookup_table_t* lookup_table, uint16_t object_id, uint16_t object_block_index);
+afs_block_t lookup_table_get_block(const lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index);
 
 //! Gets the number of blocks for a given object_id
-uint16_t lookup_table_get_num_blocks(const lookup_table_t* lookup_table, uint16_t object_id);
+uint16_t lookup_table_get_num_blocks(const lookup_table_t* lookup_table, afs_object_id_t object_id);
 
 //! Gets the last block for a given object_id
-uint16_t lookup_table_get_last_block(const lookup_table_t* lookup_table, uint16_t object_id);
+afs_block_t lookup_table_get_last_block(const lookup_table_t* lookup_table, afs_object_id_t object_id);
 
 //! Gets whether a block is v2 or not
-bool lookup_table_get_is_v2(const lookup_table_t* lookup_table, uint16_t block);
+bool lookup_table_get_is_v2(const lookup_table_t* lookup_table, afs_block_t block);
 
 //! Gets an unused, psuedo-random object ID
-uint16_t lookup_table_get_next_object_id(lookup_table_t* lookup_table);
+afs_object_id_t lookup_table_get_next_object_id(afs_impl_t* afs);
 
 //! Gets the next object in the lookup table (useful for iterating through all objects)
-uint16_t lookup_table_iter_get_next_object(const lookup_table_t* lookup_table, uint16_t *block);
+afs_object_id_t lookup_table_iter_get_next_object(const lookup_table_t* lookup_table, afs_block_t *block);
 
-//! Deletes an object from the lookup table and returns the first block
-uint16_t lookup_table_delete_object(lookup_table_t* lookup_table, uint16_t object_id);
+//! Deletes an object from the lookup table and returns the first block (which is expected to be erased by the caller
+//! unless the erase is deferred)
+afs_block_t lookup_table_delete_object(lookup_table_t* lookup_table, afs_object_id_t object_id, bool defer_erase);
+
+//! Deletes the object whose first block is the specified one, deferring the erase, and returns false if the block has
+//! already been erased
+bool lookup_table_delete_first_block(lookup_table_t* lookup_table, afs_block_t block);
 
 //! Gets the total number of blocks being used
-uint16_t lookup_table_get_total_num_blocks(const lookup_table_t* lookup_table);
+afs_block_t lookup_table_get_total_num_blocks(const lookup_table_t* lookup_table);
 
 //! Checks if all blocks are in use
 bool lookup_table_is_full(const lookup_table_t* lookup_table);
 
+//! Gets the number of blocks in each state
+void lookup_table_get_usage(const lookup_table_t* lookup_table, afs_usage_t* usage);
+
 //! Gets the next free block and assigns it to the specified object.
-uint16_t lookup_table_acquire_block(lookup_table_t* lookup_table, uint16_t object_id, uint16_t object_block_index, bool* is_erased);
+afs_block_t lookup_table_acquire_block(lookup_table_t* lookup_table, afs_object_id_t object_id, uint16_t object_block_index, bool* is_erased);
 
 //! Gets the next block which is in use and marks it to be wiped
-uint16_t lookup_table_wipe_next_in_use(lookup_table_t* lookup_table, uint16_t start_block, bool* should_erase);
+afs_block_t lookup_table_wipe_next_in_use(lookup_table_t* lookup_table, afs_block_t start_block, bool* should_erase);
 
 //! Gets the number of erased blocks
-uint16_t lookup_table_get_num_erased(const lookup_table_t* lookup_table);
+afs_block_t lookup_table_get_num_erased(const lookup_table_t* lookup_table);
 
 //! Gets the next block which is pending being erased and marks it as erased
-uint16_t lookup_table_get_next_pending_erase(lookup_table_t* lookup_table, uint16_t start_block);
+afs_block_t lookup_table_get_next_pending_erase(lookup_table_t* lookup_table);
+
+//! Gets the number of first blocks of deleted objects which haven't been erased yet
+afs_block_t lookup_table_get_num_deleted(const lookup_table_t* lookup_table);
+
+//! Iterates over the first blocks of deleted objects which haven't been erased yet (starting from INVALID_BLOCK)
+afs_block_t lookup_table_get_next_deleted(const lookup_table_t* lookup_table, afs_block_t prev_block);
+
+//! Gets the next first block of a deleted object which hasn't been erased yet and marks it as erased
+afs_block_t lookup_table_erase_next_deleted(lookup_table_t* lookup_table);
 
 //! Dumps the lookup table entry for a given block for debugging
-bool lookup_table_debug_dump_block(const lookup_table_t* lookup_table, uint16_t block);
+bool lookup_table_debug_dump_block(const lookup_table_t* lookup_table, afs_block_t block);
 
 //! Dumps the lookup table entries for an object for debugging
-void lookup_table_debug_dump_object(const lookup_table_t* lookup_table, uint16_t object_id);
+void lookup_table_debug_dump_object(const lookup_table_t* lookup_table, afs_object_id_t object_id);
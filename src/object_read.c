@@ -1,6 +1,7 @@
 #include "object_read.h"
 
 #include "afs_config.h"
+#include "cache.h"
 #include "lookup_table.h"
 #include "storage.h"
 #include "util.h"
@@ -16,11 +17,11 @@ static void process_block_header(position_t* position, afs_obj_impl_t* obj) {
 
     // Validate the header as a sanity check
     AFS_ASSERT(util_is_block_header_valid(&header, NULL));
-    AFS_ASSERT_EQ(header.object_id, obj->object_id);
+    AFS_ASSERT_EQ(util_get_block_header_object_id(&header), obj->object_id);
     AFS_ASSERT_EQ(header.object_block_index, obj->read.storage_offset / obj->storage.config->block_size);
 
     // Advance past the header
-    obj->read.storage_offset += sizeof(header);
+    obj->read.storage_offset += util_get_block_header_length(&header);
     AFS_LOG_DEBUG("Read block header");
 }
 
@@ -53,6 +54,9 @@ static bool process_new_chunk(afs_obj_impl_t* obj, position_t* position, uint32_
         case CHUNK_TYPE_SEEK:
             length_invalid = chunk_length > sizeof(seek_chunk_data_t);
             break;
+        case CHUNK_TYPE_SEEK_TABLE:
+            length_invalid = (position->offset + chunk_length) > block_end;
+            break;
         case CHUNK_TYPE_END:
             length_invalid = chunk_length > 0;
             break;
@@ -81,6 +85,7 @@ static bool process_new_chunk(afs_obj_impl_t* obj, position_t* position, uint32_
             return true;
         case CHUNK_TYPE_OFFSET:
         case CHUNK_TYPE_SEEK:
+        case CHUNK_TYPE_SEEK_TABLE:
             // Skip over this chunk
             obj->read.storage_offset += sizeof(header) + chunk_length;
             *has_more_data = true;
@@ -131,6 +136,33 @@ static void align_storage_offset(const afs_impl_t* afs, afs_obj_impl_t* obj, con
     }
 }
 
+static void read_ahead(const afs_impl_t* afs, afs_obj_impl_t* obj, uint16_t block_index, uint32_t block_end,
+        const position_t* position) {
+    const cache_t* cache = &obj->storage.cache;
+    if (!obj->storage.async_buffer || !cache_contains(cache, position)) {
+        // Not reading ahead or not reading sequentially through the cache
+        return;
+    }
+    position_t next_position = {
+        .block = cache->position.block,
+        .offset = cache->position.offset + cache->size,
+    };
+    if (obj->read.stream != AFS_WILDCARD_STREAM && position->offset + obj->read.data_chunk_length <= next_position.offset) {
+        // The rest of the current data chunk is already in the cache, and what comes after it might be another stream's
+        // data which this reader would skip over, so don't read it ahead
+        return;
+    }
+    if (next_position.offset >= block_end) {
+        // The next data is in the next block of the object
+        next_position.block = lookup_table_get_block(&afs->lookup_table, obj->object_id, block_index + 1);
+        next_position.offset = 0;
+        if (next_position.block == INVALID_BLOCK) {
+            return;
+        }
+    }
+    storage_read_ahead(&obj->storage, &next_position);
+}
+
 bool object_read_process(const afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t* data, uint32_t max_length, uint32_t* read_bytes) {
     *read_bytes = 0;
     const uint32_t block_size = obj->storage.config->block_size;
@@ -139,7 +171,7 @@ bool object_read_process(const afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t* da
         .block = lookup_table_get_block(&afs->lookup_table, obj->object_id, block_index),
         .offset = obj->read.storage_offset % block_size,
     };
-    AFS_LOG_DEBUG("Reading/seeking (index=%u, block=%u, offset=0x%"PRIx32")", block_index, position.block, position.offset);
+    AFS_LOG_DEBUG("Reading/seeking (index=%u, block=%"PRI_BLOCK", offset=0x%"PRIx32")", block_index, position.block, position.offset);
 
     if (position.block == INVALID_BLOCK && position.offset == 0) {
         // Writing got interrupted in the middle of the previous block, so just bail
@@ -158,7 +190,8 @@ bool object_read_process(const afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t* da
         // We are within a data chunk, so read as much data as possible from it
         *read_bytes = process_read_data(obj, max_length);
         if (data && *read_bytes) {
-            storage_read_data(&obj->storage, &position, data, *read_bytes);
+            storage_read_data_direct(&obj->storage, &position, data, *read_bytes);
+            read_ahead(afs, obj, block_index, block_end, &position);
         }
     } else {
         // We need to read a new chunk
@@ -32,8 +32,8 @@ static inline uint16_t estimate_calculate_index(uint64_t density, uint64_t targe
     return target_offset * DENSITY_MULTIPLIER / density / region_size;
 }
 
-static bool get_offset_chunk_data(afs_impl_t* afs, uint16_t object_id, uint16_t block_index, offset_chunk_data_t* data) {
-    const uint16_t block = lookup_table_get_block(&afs->lookup_table, object_id, block_index);
+static bool get_offset_chunk_data(afs_impl_t* afs, afs_object_id_t object_id, uint16_t block_index, offset_chunk_data_t* data) {
+    const afs_block_t block = lookup_table_get_block(&afs->lookup_table, object_id, block_index);
     return storage_read_block_header_offset_data(&afs->storage, block, data);
 }
 
@@ -113,18 +113,52 @@ static uint16_t search_block_index(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_
     return index;
 }
 
-static uint64_t get_sub_block_offset(afs_impl_t* afs, afs_obj_impl_t* obj, uint16_t index, seek_chunk_data_t* data) {
+static uint64_t get_sub_block_offset(afs_impl_t* afs, afs_obj_impl_t* obj, afs_block_t block, const seek_table_t* table, uint16_t index, seek_chunk_data_t* data) {
     memset(data, 0, sizeof(*data));
-    const uint16_t block_index = current_block_index(obj);
-    const uint16_t block = lookup_table_get_block(&afs->lookup_table, obj->object_id, block_index);
-    if (!storage_read_seek_data(&afs->storage, block, index, data)) {
+    const bool result = table ?
+        storage_read_seek_table_data(&afs->storage, block, table, index, data) :
+        storage_read_seek_data(&afs->storage, block, index, data);
+    if (!result) {
         // There must not be any data in this sub-block since the seek chunk wasn't written - return the max offset
         return UINT64_MAX;
     }
     return util_get_block_offset(data->offsets, obj->read.stream);
 }
 
-static uint16_t search_sub_block_index(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_t target_offset, uint32_t* new_block_offsets) {
+static uint16_t search_seek_table(afs_impl_t* afs, afs_obj_impl_t* obj, afs_block_t block, const seek_table_t* table, uint64_t target_offset, uint32_t* new_block_offsets) {
+    const uint32_t sub_block_size = obj->storage.config->block_size / obj->storage.config->sub_blocks_per_block;
+    const uint16_t current_index = (obj->read.storage_offset % obj->storage.config->block_size) / sub_block_size;
+    const uint16_t max_index = obj->storage.config->sub_blocks_per_block - 1;
+
+    // The table has the offsets of every sub-block, so binary search it for the last one which starts at or before the
+    // target offset
+    seek_chunk_data_t seek_data;
+    BINARY_SEARCH_DEF(current_index, max_index);
+    BINARY_SEARCH_ITER() {
+        if (get_sub_block_offset(afs, obj, block, table, BINARY_SEARCH_VALUE(), &seek_data) > target_offset) {
+            BINARY_SEARCH_RESULT_BEFORE();
+        } else {
+            BINARY_SEARCH_RESULT_AFTER();
+        }
+    }
+    const uint16_t index = BINARY_SEARCH_VALUE();
+    if (index == current_index) {
+        // Already on this index
+        return SEARCH_RESULT_NO_CHANGE;
+    }
+
+    // Get the offsets of all the streams at the start of the sub-block
+    get_sub_block_offset(afs, obj, block, table, index, &seek_data);
+    memcpy(new_block_offsets, seek_data.offsets, sizeof(seek_data.offsets));
+    return index;
+}
+
+static uint16_t search_sub_block_index(afs_impl_t* afs, afs_obj_impl_t* obj, afs_block_t block, uint64_t target_offset, uint32_t* new_block_offsets) {
+    seek_table_t table;
+    if (storage_read_seek_table(&afs->storage, block, &table)) {
+        return search_seek_table(afs, obj, block, &table, target_offset, new_block_offsets);
+    }
+
     const uint32_t sub_block_size = obj->storage.config->block_size / obj->storage.config->sub_blocks_per_block;
     const uint16_t current_index = (obj->read.storage_offset % obj->storage.config->block_size) / sub_block_size;
     const uint16_t max_index = obj->storage.config->sub_blocks_per_block - 1;
@@ -140,7 +174,7 @@ static uint16_t search_sub_block_index(afs_impl_t* afs, afs_obj_impl_t* obj, uin
     bool prev_check_was_prev_index = false;
     seek_chunk_data_t seek_data;
     while (true) {
-        if (get_sub_block_offset(afs, obj, index, &seek_data) > target_offset) {
+        if (get_sub_block_offset(afs, obj, block, NULL, index, &seek_data) > target_offset) {
             // Found the index we're after for this loop
             if (prev_check_was_prev_index) {
                 // We previously checked the previous index and it was lower, so that was the target index
@@ -167,7 +201,7 @@ static uint16_t search_sub_block_index(afs_impl_t* afs, afs_obj_impl_t* obj, uin
 
     // Linearly loop down towards the current index
     while (--index > current_index) {
-        if (get_sub_block_offset(afs, obj, index, &seek_data) > target_offset) {
+        if (get_sub_block_offset(afs, obj, block, NULL, index, &seek_data) > target_offset) {
             // Still need to go lower
             continue;
         }
@@ -205,7 +239,7 @@ uint64_t object_seek_to_block(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_t off
 
 uint64_t object_seek_to_sub_block(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_t offset) {
     const uint16_t block_index = current_block_index(obj);
-    const uint16_t block = lookup_table_get_block(&afs->lookup_table, obj->object_id, block_index);
+    const afs_block_t block = lookup_table_get_block(&afs->lookup_table, obj->object_id, block_index);
     AFS_ASSERT_NOT_EQ(block, INVALID_BLOCK);
     if (!lookup_table_get_is_v2(&afs->lookup_table, block)) {
         // No sub-blocks
@@ -215,7 +249,7 @@ uint64_t object_seek_to_sub_block(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_t
     const uint64_t prev_block_offset = util_get_block_offset(obj->block_offset, obj->read.stream);
     const uint64_t target_block_offset = prev_block_offset + offset;
     uint32_t new_block_offsets[AFS_NUM_STREAMS] = {};
-    const uint16_t new_index = search_sub_block_index(afs, obj, target_block_offset, new_block_offsets);
+    const uint16_t new_index = search_sub_block_index(afs, obj, block, target_block_offset, new_block_offsets);
     if (new_index == SEARCH_RESULT_NO_CHANGE) {
         return offset;
     }
@@ -251,9 +285,9 @@ void object_seek_to_last_block(afs_impl_t* afs, afs_obj_impl_t* obj) {
     }
 }
 
-bool object_seek_get_v2_object_size(afs_impl_t* afs, uint16_t object_id, afs_stream_bitmask_t stream_bitmask, uint64_t* size) {
+bool object_seek_get_v2_object_size(afs_impl_t* afs, afs_object_id_t object_id, afs_stream_bitmask_t stream_bitmask, uint64_t* size) {
     *size = 0;
-    const uint16_t last_block = lookup_table_get_last_block(&afs->lookup_table, object_id);
+    const afs_block_t last_block = lookup_table_get_last_block(&afs->lookup_table, object_id);
     if (last_block == INVALID_BLOCK || !lookup_table_get_is_v2(&afs->lookup_table, last_block)) {
         return false;
     }
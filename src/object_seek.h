@@ -12,4 +12,4 @@ uint64_t object_seek_to_sub_block(afs_impl_t* afs, afs_obj_impl_t* obj, uint64_t
 void object_seek_to_last_block(afs_impl_t* afs, afs_obj_impl_t* obj);
 
 //! Gets the object size for an AFS v2 object
-bool object_seek_get_v2_object_size(afs_impl_t* afs, uint16_t object_id, afs_stream_bitmask_t stream_bitmask, uint64_t* size);
+bool object_seek_get_v2_object_size(afs_impl_t* afs, afs_object_id_t object_id, afs_stream_bitmask_t stream_bitmask, uint64_t* size);
@@ -2,6 +2,8 @@
 
 #include "afs_config.h"
 #include "cache.h"
+#include "checkpoint.h"
+#include "idle.h"
 #include "lookup_table.h"
 #include "storage.h"
 #include "util.h"
@@ -13,9 +15,36 @@ static inline uint32_t cache_write_position(const cache_t* cache) {
     return cache->position.offset + cache->length;
 }
 
-//! Calculates the remaining space within the block
-static inline uint32_t remaining_block_space(afs_obj_impl_t* obj) {
-    return obj->storage.config->block_size - BLOCK_FOOTER_LENGTH - cache_write_position(&obj->storage.cache);
+//! Calculates the length of a seek table with the specified number of streams
+static inline uint32_t seek_table_length(const afs_obj_impl_t* obj, uint8_t num_streams) {
+    return sizeof(seek_table_header_t) + num_streams * (obj->storage.config->sub_blocks_per_block - 1) * sizeof(uint32_t);
+}
+
+//! Calculates the number of streams the seek table of the current block needs room for, including the specified stream
+//! if it's about to be written to the block for the first time (AFS_NUM_STREAMS for none)
+static inline uint8_t seek_table_reserved_streams(const afs_obj_impl_t* obj, uint8_t stream) {
+    const uint8_t num_streams = obj->write.seek_table_num_streams;
+    if (!obj->write.seek_table || num_streams == SEEK_TABLE_TOO_MANY_STREAMS) {
+        return 0;
+    } else if (stream < AFS_NUM_STREAMS && obj->write.seek_table_columns[stream] == SEEK_TABLE_NO_COLUMN &&
+            num_streams < obj->write.seek_table_max_streams) {
+        return num_streams + 1;
+    }
+    return num_streams;
+}
+
+//! Calculates the remaining space within the block for writing to the specified stream (AFS_NUM_STREAMS for none)
+static inline uint32_t remaining_block_space(afs_obj_impl_t* obj, uint8_t stream) {
+    uint32_t end_offset = obj->storage.config->block_size - BLOCK_FOOTER_LENGTH;
+    const uint8_t num_streams = seek_table_reserved_streams(obj, stream);
+    if (num_streams) {
+        // Leave room for the seek table along with the header of the chunk which contains it and any padding needed to
+        // get the chunk header to where readers will look for it (the seek table grows as streams are written to the
+        // block, so this might already be past the current position for a new stream)
+        end_offset -= seek_table_length(obj, num_streams) + 2 * sizeof(chunk_header_t);
+    }
+    const uint32_t write_position = cache_write_position(&obj->storage.cache);
+    return end_offset > write_position ? end_offset - write_position : 0;
 }
 
 //! Calculates the remaining spae within the sub-block
@@ -25,6 +54,19 @@ static inline uint32_t remaining_sub_block_space(afs_obj_impl_t* obj) {
     return ALIGN_UP(write_pos, sub_block_size) - write_pos;
 }
 
+//! Calculates the space needed within the block to write the specified length at the current position
+static inline uint32_t required_block_space(afs_obj_impl_t* obj, uint32_t length) {
+    const uint32_t sub_block_space = remaining_sub_block_space(obj);
+    if (!obj->write.seek_table || sub_block_space >= length) {
+        // Without a seek table, the end of the block is within its last sub-block, so there's always room at the start
+        // of the next sub-block
+        return length;
+    }
+    // Need to advance to the next sub-block, which starts with a seek chunk and might be past the space which is left
+    // before the seek table
+    return sub_block_space + sizeof(chunk_header_t) + sizeof(seek_chunk_data_t) + length;
+}
+
 //! Flushes the current write buffer
 static bool flush_write_buffer(afs_impl_t* afs, afs_obj_impl_t* obj, bool pad) {
     cache_t* cache = &obj->storage.cache;
@@ -33,21 +75,74 @@ static bool flush_write_buffer(afs_impl_t* afs, afs_obj_impl_t* obj, bool pad) {
         AFS_ASSERT_EQ(cache->position.block, INVALID_BLOCK);
         AFS_ASSERT(obj->write.next_block_index > 0);
         const uint16_t block_index = obj->write.next_block_index - 1;
+        // The block might belong to an object which was deleted without the deletion being recorded yet
+        checkpoint_flush_tombstone(afs);
         bool is_erased;
         cache->position.block = lookup_table_acquire_block(&afs->lookup_table, obj->object_id, block_index, &is_erased);
+        if (cache->position.block == INVALID_BLOCK && lookup_table_get_num_deleted(&afs->lookup_table)) {
+            // The only free blocks are the first blocks of deleted objects, so erase them now in order to use them
+            storage_sync(&obj->storage);
+            afs->erase_pool.num_inline_erases += idle_erase_deleted_blocks(afs);
+            cache->position.block = lookup_table_acquire_block(&afs->lookup_table, obj->object_id, block_index, &is_erased);
+        }
         if (cache->position.block == INVALID_BLOCK) {
             AFS_LOG_ERROR("Could not find free block");
             return false;
         }
         if (!is_erased) {
+            // There were no erased blocks available, so we have to erase inline (but not while the previous block is
+            // still being written)
+            AFS_LOG_DEBUG("Erasing block inline (block=%"PRI_BLOCK")", cache->position.block);
+            afs->erase_pool.num_inline_erases++;
+            storage_sync(&obj->storage);
             storage_erase(&afs->storage, cache->position.block);
         }
     } else {
         AFS_ASSERT_NOT_EQ(cache->position.block, INVALID_BLOCK);
     }
-    AFS_LOG_DEBUG("Flushing cache (block=%u, offset=0x%"PRIx32", length=%"PRIu32")", cache->position.block,
+    AFS_LOG_DEBUG("Flushing cache (block=%"PRI_BLOCK", offset=0x%"PRIx32", length=%"PRIu32")", cache->position.block,
         cache->position.offset, cache->length);
+    const position_t position = cache->position;
+    const uint32_t length = ALIGN_UP(cache->length, obj->storage.config->min_read_write_size);
     storage_write_cache(&obj->storage, pad);
+    // Make sure the file system doesn't have stale data cached for the region we just wrote
+    storage_invalidate(&afs->storage, &position, length);
+    return true;
+}
+
+//! Helper function to write data for an object
+static bool write_data(afs_impl_t* afs, afs_obj_impl_t* obj, const uint8_t* data, uint32_t length) {
+    cache_t* cache = &obj->storage.cache;
+    AFS_LOG_DEBUG("Writing data (length=%"PRIu32", cache.offset=0x%"PRIx32", cache.length=%"PRIu32")", length,
+        cache->position.offset, cache->length);
+    const uint32_t min_read_write_size = obj->storage.config->min_read_write_size;
+    while (length) {
+        if (!cache->length && cache->position.block != INVALID_BLOCK && length >= min_read_write_size) {
+            // The buffer is empty, so write as much as we can directly from the caller's buffer
+            const position_t position = cache->position;
+            const uint32_t write_size = ALIGN_DOWN(length, min_read_write_size);
+            AFS_LOG_DEBUG("Writing data directly (offset=0x%"PRIx32", length=%"PRIu32")", position.offset, write_size);
+            storage_write_direct(&obj->storage, data, write_size);
+            storage_invalidate(&afs->storage, &position, write_size);
+            data += write_size;
+            length -= write_size;
+            continue;
+        }
+        // Write as much as we can into the buffer
+        AFS_LOG_DEBUG("Writing data into the cache (offset=0x%"PRIx32")", cache->position.offset);
+        const uint32_t buffer_space = cache->size - cache->length;
+        const uint32_t write_size = MIN_VAL(length, buffer_space);
+        cache_write(&obj->storage.cache, data, write_size);
+        data += write_size;
+        length -= write_size;
+        if (cache->length == cache->size) {
+            // The buffer is full so flush it to disk
+            if (!flush_write_buffer(afs, obj, false)) {
+                AFS_LOG_ERROR("Error flushing write buffer");
+                return false;
+            }
+        }
+    }
     return true;
 }
 
@@ -86,6 +181,129 @@ static void cache_write_seek_chunk(afs_obj_impl_t* obj) {
     }
 }
 
+//! Resets the seek table for a new block
+static void seek_table_reset(afs_obj_impl_t* obj) {
+    if (!obj->write.seek_table) {
+        return;
+    }
+    obj->write.seek_table_num_streams = 0;
+    memset(obj->write.seek_table_columns, SEEK_TABLE_NO_COLUMN, sizeof(obj->write.seek_table_columns));
+    // Sub-blocks which don't get written to are left as UINT32_MAX
+    memset(obj->write.seek_table, 0xff, seek_table_length(obj, obj->write.seek_table_max_streams) - sizeof(seek_table_header_t));
+}
+
+//! Adds a column to the seek table for a stream which is being written to the block for the first time
+static void seek_table_add_stream(afs_obj_impl_t* obj, uint8_t stream) {
+    if (!obj->write.seek_table || obj->write.seek_table_num_streams == SEEK_TABLE_TOO_MANY_STREAMS) {
+        return;
+    } else if (obj->write.seek_table_num_streams == obj->write.seek_table_max_streams) {
+        AFS_LOG_DEBUG("Too many streams for the seek table (stream=%u)", stream);
+        obj->write.seek_table_num_streams = SEEK_TABLE_TOO_MANY_STREAMS;
+        return;
+    }
+    const uint8_t column = obj->write.seek_table_num_streams++;
+    obj->write.seek_table_columns[stream] = column;
+    // The stream didn't have any data as of the start of the sub-blocks which were already written to
+    const uint32_t sub_block_size = obj->storage.config->block_size / obj->storage.config->sub_blocks_per_block;
+    const uint32_t sub_block_index = cache_write_position(&obj->storage.cache) / sub_block_size;
+    for (uint32_t i = 0; i < sub_block_index; i++) {
+        obj->write.seek_table[i * obj->write.seek_table_max_streams + column] = 0;
+    }
+}
+
+//! Records the offsets of the streams at the start of the current sub-block in the seek table
+static void seek_table_add_sub_block(afs_obj_impl_t* obj) {
+    if (!obj->write.seek_table || obj->write.seek_table_num_streams == SEEK_TABLE_TOO_MANY_STREAMS) {
+        return;
+    }
+    const uint32_t sub_block_size = obj->storage.config->block_size / obj->storage.config->sub_blocks_per_block;
+    const uint32_t sub_block_index = cache_write_position(&obj->storage.cache) / sub_block_size;
+    AFS_ASSERT(sub_block_index > 0);
+    uint32_t* row = &obj->write.seek_table[(sub_block_index - 1) * obj->write.seek_table_max_streams];
+    for (uint8_t i = 0; i < AFS_NUM_STREAMS; i++) {
+        const uint8_t column = obj->write.seek_table_columns[i];
+        if (column != SEEK_TABLE_NO_COLUMN) {
+            row[column] = obj->block_offset[i];
+        }
+    }
+}
+
+//! Writes the seek table (within a chunk which covers everything up to the footer) into the end of the current block
+static bool write_seek_table(afs_impl_t* afs, afs_obj_impl_t* obj) {
+    cache_t* cache = &obj->storage.cache;
+    const uint32_t footer_offset = afs->storage_config.block_size - BLOCK_FOOTER_LENGTH;
+    const uint32_t table_offset = footer_offset - seek_table_length(obj, obj->write.seek_table_num_streams);
+
+    // Readers move on to the next sub-block if there isn't room for another chunk in the current one, so pad out the
+    // current one in that case in order for them to find the chunk header
+    const uint32_t sub_block_space = remaining_sub_block_space(obj);
+    if (sub_block_space && sub_block_space <= sizeof(chunk_header_t)) {
+        cache_write(cache, NULL, sub_block_space);
+        if (cache->length == cache->size && !flush_write_buffer(afs, obj, false)) {
+            AFS_LOG_ERROR("Error flushing write buffer");
+            return false;
+        }
+    }
+
+    // Write the chunk header
+    const uint32_t chunk_offset = cache_write_position(cache);
+    AFS_LOG_DEBUG("Writing seek table (chunk_offset=0x%"PRIx32", table_offset=0x%"PRIx32")", chunk_offset, table_offset);
+    AFS_ASSERT(chunk_offset + sizeof(chunk_header_t) <= table_offset);
+    const chunk_header_t chunk_header = {
+        .tag = CHUNK_TAG_VALUE(CHUNK_TYPE_SEEK_TABLE, footer_offset - chunk_offset - sizeof(chunk_header_t)),
+    };
+    if (!write_data(afs, obj, (const uint8_t*)&chunk_header, sizeof(chunk_header))) {
+        AFS_LOG_ERROR("Error writing chunk header");
+        return false;
+    }
+
+    // Advance to the table, leaving the space in between unwritten if the table isn't within the current cache
+    if (table_offset >= cache->position.offset + cache->size) {
+        if (cache->length && !flush_write_buffer(afs, obj, true)) {
+            AFS_LOG_ERROR("Error flushing write buffer");
+            return false;
+        }
+        AFS_ASSERT_NOT_EQ(cache->position.block, INVALID_BLOCK);
+        cache->length = 0;
+        cache->position.offset = ALIGN_DOWN(table_offset, afs->storage_config.min_read_write_size);
+    }
+    cache_write(cache, NULL, table_offset - cache_write_position(cache));
+
+    // Write the header followed by the offsets of the streams (in ascending order) at the start of each sub-block
+    seek_table_header_t header = {};
+    for (uint8_t i = 0; i < AFS_NUM_STREAMS; i++) {
+        if (obj->write.seek_table_columns[i] != SEEK_TABLE_NO_COLUMN) {
+            header.stream_bitmask |= 1 << i;
+        }
+    }
+    if (!write_data(afs, obj, (const uint8_t*)&header, sizeof(header))) {
+        AFS_LOG_ERROR("Error writing seek table header");
+        return false;
+    }
+    // Pack the rows of the table together within the buffer with the columns in stream order so that it can be written
+    // all at once (each packed row ends before the next unpacked one starts)
+    const uint8_t num_streams = obj->write.seek_table_num_streams;
+    const uint32_t num_rows = afs->storage_config.sub_blocks_per_block - 1;
+    for (uint32_t i = 0; i < num_rows; i++) {
+        const uint32_t* row = &obj->write.seek_table[i * obj->write.seek_table_max_streams];
+        uint32_t packed_row[AFS_NUM_STREAMS];
+        uint8_t num_columns = 0;
+        for (uint8_t j = 0; j < AFS_NUM_STREAMS; j++) {
+            const uint8_t column = obj->write.seek_table_columns[j];
+            if (column != SEEK_TABLE_NO_COLUMN) {
+                packed_row[num_columns++] = row[column];
+            }
+        }
+        memcpy(&obj->write.seek_table[i * num_streams], packed_row, num_streams * sizeof(uint32_t));
+    }
+    if (!write_data(afs, obj, (const uint8_t*)obj->write.seek_table, num_rows * num_streams * sizeof(uint32_t))) {
+        AFS_LOG_ERROR("Error writing seek table");
+        return false;
+    }
+    AFS_ASSERT_EQ(cache_write_position(cache), footer_offset);
+    return true;
+}
+
 //! Helper function to write the footer at the end of the current block
 static bool write_footer(afs_impl_t* afs, afs_obj_impl_t* obj) {
     cache_t* cache = &obj->storage.cache;
@@ -93,6 +311,12 @@ static bool write_footer(afs_impl_t* afs, afs_obj_impl_t* obj) {
         cache->length);
     const uint32_t footer_offset = afs->storage_config.block_size - BLOCK_FOOTER_LENGTH;
     AFS_ASSERT(cache->position.offset + cache->length <= footer_offset);
+    const bool has_seek_table = obj->write.seek_table && obj->write.seek_table_num_streams &&
+        obj->write.seek_table_num_streams != SEEK_TABLE_TOO_MANY_STREAMS;
+    if (has_seek_table && !write_seek_table(afs, obj)) {
+        AFS_LOG_ERROR("Error writing seek table");
+        return false;
+    }
     if (cache->position.offset + cache->size < afs->storage_config.block_size) {
         // The current cache doesn't go to the end of the block, so flush it to disk
         AFS_ASSERT(cache->position.offset + cache->size <= footer_offset);
@@ -126,6 +350,14 @@ static bool write_footer(afs_impl_t* afs, afs_obj_impl_t* obj) {
     // Write the seek chunk
     cache_write_seek_chunk(obj);
 
+    if (has_seek_table) {
+        // Write the header of a seek table chunk with the length of the seek table which precedes the footer
+        const chunk_header_t seek_table_chunk_header = {
+            .tag = CHUNK_TAG_VALUE(CHUNK_TYPE_SEEK_TABLE, seek_table_length(obj, obj->write.seek_table_num_streams)),
+        };
+        cache_write(cache, &seek_table_chunk_header, sizeof(seek_table_chunk_header));
+    }
+
     // Flush the buffer
     if (!flush_write_buffer(afs, obj, true)) {
         AFS_LOG_ERROR("Error flushing write buffer");
@@ -134,39 +366,21 @@ static bool write_footer(afs_impl_t* afs, afs_obj_impl_t* obj) {
     return true;
 }
 
-//! Helper function to write data for an object
-static bool write_data(afs_impl_t* afs, afs_obj_impl_t* obj, const uint8_t* data, uint32_t length) {
-    cache_t* cache = &obj->storage.cache;
-    AFS_LOG_DEBUG("Writing data (length=%"PRIu32", cache.offset=0x%"PRIx32", cache.length=%"PRIu32")", length,
-        cache->position.offset, cache->length);
-    while (length) {
-        // Write as much as we can into the buffer
-        AFS_LOG_DEBUG("Writing data into the cache (offset=0x%"PRIx32")", cache->position.offset);
-        const uint32_t buffer_space = cache->size - cache->length;
-        const uint32_t write_size = MIN_VAL(length, buffer_space);
-        cache_write(&obj->storage.cache, data, write_size);
-        data += write_size;
-        length -= write_size;
-        if (cache->length == cache->size) {
-            // The buffer is full so flush it to disk
-            if (!flush_write_buffer(afs, obj, false)) {
-                AFS_LOG_ERROR("Error flushing write buffer");
-                return false;
-            }
-        }
-    }
-    return true;
-}
-
 static bool write_block_header(afs_impl_t* afs, afs_obj_impl_t* obj) {
     AFS_ASSERT_NOT_EQ(obj->object_id, INVALID_OBJECT_ID);
     cache_t* cache = &obj->storage.cache;
+    if (obj->write.next_block_index == UINT16_MAX) {
+        // The object block index is 16 bits on the storage, which can only run out with 32-bit block numbers
+        AFS_LOG_ERROR("Object is too large (object_id=%"PRIu32")", obj->object_id);
+        return false;
+    }
 
-    AFS_LOG_DEBUG("Writing block header (object_id=%u, object_block_index=%u)", obj->object_id, obj->write.next_block_index);
+    AFS_LOG_DEBUG("Writing block header (object_id=%"PRIu32", object_block_index=%u)", obj->object_id, obj->write.next_block_index);
     const block_header_t block_header = {
-        .magic.val = HEADER_MAGIC_VALUE_V2.val,
-        .object_id = obj->object_id,
+        .magic.val = HEADER_MAGIC_VALUE_V3.val,
+        .object_id = (uint16_t)obj->object_id,
         .object_block_index = obj->write.next_block_index++,
+        .object_id_high = obj->object_id >> 16,
     };
     if (!write_data(afs, obj, (const uint8_t*)&block_header, sizeof(block_header))) {
         AFS_LOG_ERROR("Error writing block header");
@@ -208,14 +422,15 @@ static bool write_block_header(afs_impl_t* afs, afs_obj_impl_t* obj) {
     return true;
 }
 
-//! Helper function to prepare for writing at least `length` bytes of data
-static uint32_t prepare_for_write(afs_impl_t* afs, afs_obj_impl_t* obj, uint32_t length) {
+//! Helper function to prepare for writing at least `length` bytes of data to the specified stream (AFS_NUM_STREAMS for
+//! none)
+static uint32_t prepare_for_write(afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t stream, uint32_t length) {
     cache_t* cache = &obj->storage.cache;
     AFS_LOG_DEBUG("Preparing for write (length=%"PRIu32", position=0x%"PRIx32")", length, cache_write_position(cache));
 
     // Check if we're at the end of the block
-    const uint32_t block_space = remaining_block_space(obj);
-    if (block_space < length) {
+    const uint32_t block_space = remaining_block_space(obj, stream);
+    if (block_space < required_block_space(obj, length)) {
         AFS_LOG_DEBUG("Not enough space left in block (%"PRIu32")", block_space);
         // Not enough room left in this block, so write out the footer and advance to the next block
         if (!write_footer(afs, obj)) {
@@ -235,6 +450,7 @@ static uint32_t prepare_for_write(afs_impl_t* afs, afs_obj_impl_t* obj, uint32_t
     // Check if we're at the start of a block
     if (cache_write_position(cache) == 0) {
         // This is the first write in a block, so write the header
+        seek_table_reset(obj);
         if (!write_block_header(afs, obj)) {
             AFS_LOG_ERROR("Error writing block header");
             return 0;
@@ -257,21 +473,25 @@ static uint32_t prepare_for_write(afs_impl_t* afs, afs_obj_impl_t* obj, uint32_t
             }
         }
         // Write the seek chunk
+        seek_table_add_sub_block(obj);
         cache_write_seek_chunk(obj);
     }
 
-    const uint32_t write_space = MIN_VAL(remaining_block_space(obj), remaining_sub_block_space(obj));
+    const uint32_t write_space = MIN_VAL(remaining_block_space(obj, stream), remaining_sub_block_space(obj));
     AFS_ASSERT(write_space > 0);
     return write_space;
 }
 
 uint32_t object_write_process(afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t stream, const void* data, uint32_t length) {
     // Make sure we can write the chunk header and at least 1 byte of data in the current block
-    const uint32_t write_space = prepare_for_write(afs, obj, sizeof(chunk_header_t) + 1);
+    const uint32_t write_space = prepare_for_write(afs, obj, stream, sizeof(chunk_header_t) + 1);
     if (!write_space) {
         AFS_LOG_ERROR("Error preparing for writing");
         return 0;
     }
+    if (!obj->block_offset[stream]) {
+        seek_table_add_stream(obj, stream);
+    }
 
     // Write the chunk header
     const uint32_t chunk_length = MIN_VAL(MIN_VAL(length, write_space - sizeof(chunk_header_t)), CHUNK_MAX_LENGTH);
@@ -294,9 +514,10 @@ uint32_t object_write_process(afs_impl_t* afs, afs_obj_impl_t* obj, uint8_t stre
     return chunk_length;
 }
 
-bool object_write_finish(afs_impl_t* afs, afs_obj_impl_t* obj) {
+//! Helper function to write the end chunk and block footer
+static bool write_end(afs_impl_t* afs, afs_obj_impl_t* obj) {
     // Make sure we can write the end chunk header in the current block
-    if (!prepare_for_write(afs, obj, sizeof(chunk_header_t))) {
+    if (!prepare_for_write(afs, obj, AFS_NUM_STREAMS, sizeof(chunk_header_t))) {
         AFS_LOG_ERROR("Error preparing for writing");
         return false;
     }
@@ -317,3 +538,10 @@ bool object_write_finish(afs_impl_t* afs, afs_obj_impl_t* obj) {
 
     return true;
 }
+
+bool object_write_finish(afs_impl_t* afs, afs_obj_impl_t* obj) {
+    const bool result = write_end(afs, obj);
+    // Wait for any background write to complete before the object is closed
+    storage_sync(&obj->storage);
+    return result;
+}
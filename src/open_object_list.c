@@ -36,7 +36,7 @@ void open_object_list_remove(afs_impl_t* afs, afs_obj_impl_t* obj) {
     AFS_FAIL("Did not find object in list");
 }
 
-bool open_object_list_contains(const afs_impl_t* afs, uint16_t object_id) {
+bool open_object_list_contains(const afs_impl_t* afs, afs_object_id_t object_id) {
     FOREACH_OPEN_OBJECT_CONST(afs, open_obj) {
         if (open_obj->object_id == object_id) {
             return true;
@@ -45,11 +45,20 @@ bool open_object_list_contains(const afs_impl_t* afs, uint16_t object_id) {
     return false;
 }
 
+bool open_object_list_is_writing(const afs_impl_t* afs, afs_object_id_t object_id) {
+    FOREACH_OPEN_OBJECT_CONST(afs, open_obj) {
+        if (open_obj->object_id == object_id && open_obj->state == OBJ_STATE_WRITING) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool open_object_list_is_empty(const afs_impl_t* afs) {
     return !afs->open_object_list_head;
 }
 
-uint16_t open_object_list_get_writing_no_storage(afs_impl_t* afs, uint16_t prev_index) {
+afs_object_id_t open_object_list_get_writing_no_storage(afs_impl_t* afs, uint16_t prev_index) {
     // Check the objects which are open for writing and haven't written to the storage yet
     uint16_t open_index = 0;
     FOREACH_OPEN_OBJECT_CONST(afs, open_obj) {
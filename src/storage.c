@@ -6,12 +6,34 @@
 
 #include <string.h>
 
+static bool is_read_ahead_pending(const storage_t* storage, const position_t* position) {
+    return storage->async_state == ASYNC_STATE_READING && storage->async_position.block == position->block &&
+        storage->async_position.offset == ALIGN_DOWN(position->offset, storage->cache.size);
+}
+
 static void populate_cache(storage_t* storage, const position_t* position) {
     cache_t* cache = &storage->cache;
     cache->position.block = position->block;
     cache->position.offset = ALIGN_DOWN(position->offset, cache->size);
-    storage->config->read(cache->buffer, cache->position.block, cache->position.offset, cache->size);
     cache->length = cache->size;
+    if (is_read_ahead_pending(storage, &cache->position)) {
+        // The data is already being read in the background, so wait for it and swap buffers
+        storage->config->read_async_wait(storage->async_buffer);
+        storage->async_state = ASYNC_STATE_IDLE;
+        uint8_t* buffer = cache->buffer;
+        cache->buffer = storage->async_buffer;
+        storage->async_buffer = buffer;
+        return;
+    }
+    // Wait for any read ahead of somewhere else since we can't reuse its buffer until it's complete
+    storage_sync(storage);
+    metadata_cache_t* metadata_cache = storage->metadata_cache;
+    if (!metadata_cache || !metadata_cache_read(metadata_cache, &cache->position, cache->buffer)) {
+        storage->config->read(cache->buffer, cache->position.block, cache->position.offset, cache->size);
+        if (metadata_cache) {
+            metadata_cache_write(metadata_cache, &cache->position, cache->buffer);
+        }
+    }
 }
 
 static bool read_seek_chunk(storage_t* storage, position_t* position, seek_chunk_data_t* data) {
@@ -59,15 +81,27 @@ static bool read_seek_chunk(storage_t* storage, position_t* position, seek_chunk
     return true;
 }
 
-void storage_read_data(storage_t* storage, position_t* position, void* buf, uint32_t length) {
+static void read_data(storage_t* storage, position_t* position, void* buf, uint32_t length, bool allow_direct) {
     AFS_ASSERT_NOT_EQ(position->block, INVALID_BLOCK);
     AFS_ASSERT(position->offset + length <= storage->config->block_size);
+    const uint32_t min_read_write_size = storage->config->min_read_write_size;
     bool is_first = true;
     while (length > 0) {
         if (cache_contains(&storage->cache, position)) {
             // We shouldn't get here after the first loop since we should have read all the way to the end of the cache
             // in the prior loop
             AFS_ASSERT(is_first);
+        } else if (allow_direct && position->offset % min_read_write_size == 0 && length >= min_read_write_size &&
+                !is_read_ahead_pending(storage, position)) {
+            // Read as much as we can directly into the buffer rather than going through the cache
+            const uint32_t read_length = ALIGN_DOWN(length, min_read_write_size);
+            storage->config->read(buf, position->block, position->offset, read_length);
+            position->offset += read_length;
+            buf += read_length;
+            length -= read_length;
+            // The rest may already be in the cache
+            is_first = true;
+            continue;
         } else {
             // Populate the cache for the requested position
             populate_cache(storage, position);
@@ -85,7 +119,25 @@ void storage_read_data(storage_t* storage, position_t* position, void* buf, uint
     }
 }
 
-bool storage_read_block_header_offset_data(storage_t* storage, uint16_t block, offset_chunk_data_t* data) {
+void storage_read_data(storage_t* storage, position_t* position, void* buf, uint32_t length) {
+    read_data(storage, position, buf, length, false);
+}
+
+void storage_read_data_direct(storage_t* storage, position_t* position, void* buf, uint32_t length) {
+    read_data(storage, position, buf, length, true);
+}
+
+void storage_read_block_header(storage_t* storage, position_t* position, block_header_t* header) {
+    storage_read_data(storage, position, header, BLOCK_HEADER_V2_LENGTH);
+    uint8_t* header_ext = (uint8_t*)header + BLOCK_HEADER_V2_LENGTH;
+    if (header->magic.val == HEADER_MAGIC_VALUE_V3.val) {
+        storage_read_data(storage, position, header_ext, sizeof(*header) - BLOCK_HEADER_V2_LENGTH);
+    } else {
+        memset(header_ext, 0, sizeof(*header) - BLOCK_HEADER_V2_LENGTH);
+    }
+}
+
+bool storage_read_block_header_offset_data(storage_t* storage, afs_block_t block, offset_chunk_data_t* data) {
     // Create a read pointer
     position_t position = {
         .block = block,
@@ -94,7 +146,7 @@ bool storage_read_block_header_offset_data(storage_t* storage, uint16_t block, o
 
     // Read the block header for validation
     block_header_t block_header;
-    storage_read_data(storage, &position, &block_header, sizeof(block_header));
+    storage_read_block_header(storage, &position, &block_header);
     AFS_ASSERT(util_is_block_header_valid(&block_header, NULL));
 
     // Read the offset chunk header
@@ -128,25 +180,28 @@ bool storage_read_block_header_offset_data(storage_t* storage, uint16_t block, o
     return true;
 }
 
-bool storage_read_block_footer_seek_data(storage_t* storage, uint16_t block, seek_chunk_data_t* data) {
-    // Create a read pointer
-    position_t position = {
-        .block = block,
-        .offset = storage->config->block_size - BLOCK_FOOTER_LENGTH,
-    };
-
+static bool read_block_footer(storage_t* storage, position_t* position, seek_chunk_data_t* data) {
     // Read the footer for validation
     block_footer_t footer;
-    storage_read_data(storage, &position, &footer, sizeof(footer));
+    storage_read_data(storage, position, &footer, sizeof(footer));
     if (footer.magic.val != FOOTER_MAGIC_VALUE.val) {
         return false;
     }
 
     // Read the seek chunk
-    return read_seek_chunk(storage, &position, data);
+    return read_seek_chunk(storage, position, data);
+}
+
+bool storage_read_block_footer_seek_data(storage_t* storage, afs_block_t block, seek_chunk_data_t* data) {
+    // Create a read pointer
+    position_t position = {
+        .block = block,
+        .offset = storage->config->block_size - BLOCK_FOOTER_LENGTH,
+    };
+    return read_block_footer(storage, &position, data);
 }
 
-bool storage_read_seek_data(storage_t* storage, uint16_t block, uint32_t sub_block_index, seek_chunk_data_t* data) {
+bool storage_read_seek_data(storage_t* storage, afs_block_t block, uint32_t sub_block_index, seek_chunk_data_t* data) {
     if (sub_block_index == 0) {
         // The first sub-block has all offsets of 0
         memset(data, 0, sizeof(*data));
@@ -162,6 +217,71 @@ bool storage_read_seek_data(storage_t* storage, uint16_t block, uint32_t sub_blo
     return read_seek_chunk(storage, &position, data);
 }
 
+bool storage_read_seek_table(storage_t* storage, afs_block_t block, seek_table_t* table) {
+    // Read past the block footer to the seek table chunk header which follows it
+    const uint32_t footer_offset = storage->config->block_size - BLOCK_FOOTER_LENGTH;
+    position_t position = {
+        .block = block,
+        .offset = footer_offset,
+    };
+    seek_chunk_data_t seek_data = {};
+    if (!read_block_footer(storage, &position, &seek_data)) {
+        return false;
+    }
+    chunk_header_t chunk_header;
+    storage_read_chunk_header(storage, &position, &chunk_header);
+    if (CHUNK_TAG_GET_TYPE(chunk_header.tag) != CHUNK_TYPE_SEEK_TABLE) {
+        // No seek table (the rest of the footer is zero)
+        return false;
+    }
+
+    // Read the seek table header which is at the length of the table before the footer
+    const uint32_t table_length = CHUNK_TAG_GET_LENGTH(chunk_header.tag);
+    if (table_length < sizeof(seek_table_header_t) || table_length > footer_offset) {
+        AFS_LOG_ERROR("Invalid seek table chunk (0x%"PRIx32")", chunk_header.tag);
+        return false;
+    }
+    position.offset = footer_offset - table_length;
+    seek_table_header_t header;
+    storage_read_data(storage, &position, &header, sizeof(header));
+    const uint8_t num_streams = __builtin_popcount(header.stream_bitmask);
+    if (table_length != sizeof(header) + num_streams * (storage->config->sub_blocks_per_block - 1) * sizeof(uint32_t)) {
+        AFS_LOG_ERROR("Invalid seek table (length=%"PRIu32", stream_bitmask=0x%x)", table_length, header.stream_bitmask);
+        return false;
+    }
+    *table = (seek_table_t) {
+        .offset = position.offset,
+        .stream_bitmask = header.stream_bitmask,
+        .num_streams = num_streams,
+    };
+    return true;
+}
+
+bool storage_read_seek_table_data(storage_t* storage, afs_block_t block, const seek_table_t* table, uint32_t sub_block_index, seek_chunk_data_t* data) {
+    if (sub_block_index == 0) {
+        // The first sub-block has all offsets of 0
+        memset(data, 0, sizeof(*data));
+        return true;
+    }
+    position_t position = {
+        .block = block,
+        .offset = table->offset + (sub_block_index - 1) * table->num_streams * sizeof(uint32_t),
+    };
+    for (uint8_t i = 0; i < AFS_NUM_STREAMS; i++) {
+        if (!(table->stream_bitmask & (1 << i))) {
+            continue;
+        }
+        uint32_t value;
+        storage_read_data(storage, &position, &value, sizeof(value));
+        if (value == UINT32_MAX) {
+            // The sub-block wasn't written to
+            return false;
+        }
+        data->offsets[i] = value;
+    }
+    return true;
+}
+
 void storage_write_cache(storage_t* storage, bool pad) {
     cache_t* cache = &storage->cache;
 
@@ -175,12 +295,23 @@ void storage_write_cache(storage_t* storage, bool pad) {
     AFS_ASSERT(cache->position.offset + aligned_length <= storage->config->block_size);
 
     // Write the data
-    storage->config->write(cache->buffer, cache->position.block, cache->position.offset, aligned_length);
+    if (storage->async_buffer) {
+        // Wait for the previous write so its buffer is free, then write this one in the background and swap buffers so
+        // the caller can keep filling the cache in the meantime (only having a single write in flight keeps them ordered)
+        storage_sync(storage);
+        storage->config->write_async(cache->buffer, cache->position.block, cache->position.offset, aligned_length);
+        uint8_t* buffer = cache->buffer;
+        cache->buffer = storage->async_buffer;
+        storage->async_buffer = buffer;
+        storage->async_state = ASYNC_STATE_WRITING;
+    } else {
+        storage->config->write(cache->buffer, cache->position.block, cache->position.offset, aligned_length);
+    }
 
     // Invalidate the file system cache
     const position_t position = {
         .block = cache->position.block,
-        .offset = cache->position.block,
+        .offset = cache->position.offset,
     };
     cache_invalidate(cache, &position, aligned_length);
 
@@ -197,11 +328,100 @@ void storage_write_cache(storage_t* storage, bool pad) {
     }
 }
 
-void storage_erase(storage_t* storage, uint16_t block) {
+void storage_read_ahead(storage_t* storage, const position_t* position) {
+    const cache_t* cache = &storage->cache;
+    AFS_ASSERT_EQ(position->offset % cache->size, 0);
+    if (!storage->async_buffer || cache_contains(cache, position) || is_read_ahead_pending(storage, position)) {
+        return;
+    }
+    storage_sync(storage);
+    const uint32_t length = MIN_VAL(cache->size, storage->config->block_size - position->offset);
+    storage->config->read_async(storage->async_buffer, position->block, position->offset, length);
+    storage->async_state = ASYNC_STATE_READING;
+    storage->async_position = *position;
+}
+
+void storage_sync(storage_t* storage) {
+    switch (storage->async_state) {
+        case ASYNC_STATE_IDLE:
+            return;
+        case ASYNC_STATE_WRITING:
+            storage->config->write_async_wait(storage->async_buffer);
+            break;
+        case ASYNC_STATE_READING:
+            storage->config->read_async_wait(storage->async_buffer);
+            break;
+    }
+    storage->async_state = ASYNC_STATE_IDLE;
+}
+
+void storage_write_direct(storage_t* storage, const void* data, uint32_t length) {
+    cache_t* cache = &storage->cache;
+    AFS_ASSERT_EQ(cache->length, 0);
+    AFS_ASSERT_NOT_EQ(cache->position.block, INVALID_BLOCK);
+    AFS_ASSERT_EQ(length % storage->config->min_read_write_size, 0);
+    AFS_ASSERT(cache->position.offset + length <= storage->config->block_size);
+
+    // Write the data (after any pending asynchronous write so that they stay in order)
+    storage_sync(storage);
+    storage->config->write(data, cache->position.block, cache->position.offset, length);
+
+    // Advance the cache forward
+    cache->position.offset += length;
+    if (cache->position.offset == storage->config->block_size) {
+        // No more space in the current block, so advance to the next one
+        cache->position = (position_t) {
+            .block = INVALID_BLOCK,
+            .offset = 0,
+        };
+    }
+}
+
+void storage_invalidate(storage_t* storage, const position_t* position, uint32_t length) {
+    cache_invalidate(&storage->cache, position, length);
+    if (storage->metadata_cache) {
+        metadata_cache_invalidate(storage->metadata_cache, position, length);
+    }
+}
+
+void storage_erase(storage_t* storage, afs_block_t block) {
     storage->config->erase(block);
     const position_t position = {
         .block = block,
         .offset = 0,
     };
-    cache_invalidate(&storage->cache, &position, storage->config->block_size);
+    storage_invalidate(storage, &position, storage->config->block_size);
+}
+
+void storage_erase_batch_add(storage_t* storage, erase_batch_t* batch, afs_block_t block) {
+    if (batch->num_blocks && block == batch->first_block + batch->num_blocks) {
+        // Extend the current range
+        batch->num_blocks++;
+        return;
+    }
+    storage_erase_batch_flush(storage, batch);
+    *batch = (erase_batch_t) {
+        .first_block = block,
+        .num_blocks = 1,
+    };
+}
+
+void storage_erase_batch_flush(storage_t* storage, erase_batch_t* batch) {
+    if (!batch->num_blocks) {
+        return;
+    } else if (batch->num_blocks == 1 || !storage->config->erase_range) {
+        for (afs_block_t i = 0; i < batch->num_blocks; i++) {
+            storage_erase(storage, batch->first_block + i);
+        }
+    } else {
+        storage->config->erase_range(batch->first_block, batch->num_blocks);
+        for (afs_block_t i = 0; i < batch->num_blocks; i++) {
+            const position_t position = {
+                .block = batch->first_block + i,
+                .offset = 0,
+            };
+            storage_invalidate(storage, &position, storage->config->block_size);
+        }
+    }
+    batch->num_blocks = 0;
 }
@@ -10,10 +10,11 @@
 //! Reads data from storage
 void storage_read_data(storage_t* storage, position_t* position, void* buf, uint32_t length);
 
-//! Reads a block header from storage
-static inline void storage_read_block_header(storage_t* storage, position_t* position, block_header_t* header) {
-    storage_read_data(storage, position, header, sizeof(*header));
-}
+//! Reads data from storage, bypassing the cache for any aligned portions by reading directly into the buffer
+void storage_read_data_direct(storage_t* storage, position_t* position, void* buf, uint32_t length);
+
+//! Reads a block header from storage (the fields which only exist in AFS3 blocks are zeroed for other blocks)
+void storage_read_block_header(storage_t* storage, position_t* position, block_header_t* header);
 
 //! Reads a chunk header from storage
 static inline void storage_read_chunk_header(storage_t* storage, position_t* position, chunk_header_t* header) {
@@ -21,16 +22,43 @@ static inline void storage_read_chunk_header(storage_t* storage, position_t* pos
 }
 
 //! Reads the block footer from storage and returns the offset chunk data
-bool storage_read_block_header_offset_data(storage_t* storage, uint16_t block, offset_chunk_data_t* data);
+bool storage_read_block_header_offset_data(storage_t* storage, afs_block_t block, offset_chunk_data_t* data);
 
 //! Reads the block footer from storage and returns the seek chunk data
-bool storage_read_block_footer_seek_data(storage_t* storage, uint16_t block, seek_chunk_data_t* data);
+bool storage_read_block_footer_seek_data(storage_t* storage, afs_block_t block, seek_chunk_data_t* data);
 
 //! Reads the seek chunk data from storage from the start of a sub-block
-bool storage_read_seek_data(storage_t* storage, uint16_t block, uint32_t sub_block_index, seek_chunk_data_t* data);
+bool storage_read_seek_data(storage_t* storage, afs_block_t block, uint32_t sub_block_index, seek_chunk_data_t* data);
+
+//! Reads the location of the seek table from the block footer (returns false if the block doesn't have one)
+bool storage_read_seek_table(storage_t* storage, afs_block_t block, seek_table_t* table);
+
+//! Reads the seek chunk data for the start of a sub-block from the seek table of a block
+bool storage_read_seek_table_data(storage_t* storage, afs_block_t block, const seek_table_t* table, uint32_t sub_block_index, seek_chunk_data_t* data);
 
 //! Writes cached data out to storage
 void storage_write_cache(storage_t* storage, bool pad);
 
+//! Starts reading the (cache-aligned) position into the async buffer in the background, if there is one, so that it's
+//! ready by the time the cache needs to be populated with it
+void storage_read_ahead(storage_t* storage, const position_t* position);
+
+//! Waits for any pending asynchronous write or read ahead to complete
+void storage_sync(storage_t* storage);
+
+//! Writes data directly to storage at the current position of the (empty) cache and advances it
+void storage_write_direct(storage_t* storage, const void* data, uint32_t length);
+
+//! Invalidates any cached data which overlaps with the specified region (i.e. because it was written by another
+//! storage context)
+void storage_invalidate(storage_t* storage, const position_t* position, uint32_t length);
+
 //! Erases a block of storage
-void storage_erase(storage_t* storage, uint16_t block);
+void storage_erase(storage_t* storage, afs_block_t block);
+
+//! Adds a block to a batch of blocks to erase, which are coalesced into contiguous ranges (the batch should be
+//! initially cleared, and any preceding range is erased once a block which isn't adjacent to it is added)
+void storage_erase_batch_add(storage_t* storage, erase_batch_t* batch, afs_block_t block);
+
+//! Erases any blocks remaining in a batch
+void storage_erase_batch_flush(storage_t* storage, erase_batch_t* batch);
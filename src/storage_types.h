@@ -1,12 +1,14 @@
 #pragma once
 
 #include <inttypes.h>
+#include <stddef.h>
 
 #define CHUNK_TYPE_DATA_FIRST           0xd0
 #define CHUNK_TYPE_DATA_LAST            0xdf
 #define CHUNK_TYPE_END                  0xed
 #define CHUNK_TYPE_OFFSET               0x3e
 #define CHUNK_TYPE_SEEK                 0x5e
+#define CHUNK_TYPE_SEEK_TABLE           0x5f
 #define CHUNK_TYPE_INVALID_ZERO         0x00
 #define CHUNK_TYPE_INVALID_ONE          0xff
 
@@ -37,26 +39,81 @@ _Static_assert(sizeof(magic_value_t) == 4, "Invalid magic value size");
 // Block magic values
 static const magic_value_t HEADER_MAGIC_VALUE_V1 = {.str = {'A', 'F', 'S', '1'}};
 static const magic_value_t HEADER_MAGIC_VALUE_V2 = {.str = {'A', 'F', 'S', '2'}};
+static const magic_value_t HEADER_MAGIC_VALUE_V3 = {.str = {'A', 'F', 'S', '3'}};
 static const magic_value_t FOOTER_MAGIC_VALUE = {.str = {'a', 'f', 's', '2'}};
 
+// Checkpoint magic values (`afse` for the checkpoint header and `afsd` for the tombstone)
+static const magic_value_t CHECKPOINT_MAGIC_VALUE = {.str = {'a', 'f', 's', 'e'}};
+static const magic_value_t TOMBSTONE_MAGIC_VALUE = {.str = {'a', 'f', 's', 'd'}};
+
 #pragma pack(push, 1)
 
-// On-disk block header type
+// On-disk block header type (AFS1 and AFS2 blocks end the header after the object block index)
 typedef struct {
     // Magic value
     magic_value_t magic;
-    // The object ID which is stored in this block
+    // The object ID which is stored in this block (only the lower 16 bits for AFS3 blocks)
     uint16_t object_id;
     // The block index of the object stored in this block
     uint16_t object_block_index;
+    // The upper 16 bits of the object ID (AFS3 blocks only)
+    uint16_t object_id_high;
+    // Reserved for future use (AFS3 blocks only)
+    uint16_t reserved;
 } block_header_t;
 
-// On-disk block footer type
+// The length of the block header of AFS1 and AFS2 blocks
+#define BLOCK_HEADER_V2_LENGTH          offsetof(block_header_t, object_id_high)
+
+// On-disk block footer type (followed by a seek chunk and then, if the block has a seek table, a seek table chunk
+// header whose length is that of the seek table which immediately precedes the footer)
 typedef struct {
     // Magic value
     magic_value_t magic;
 } block_footer_t;
 
+// On-disk seek table header type (followed by the offsets of each stream in the bitmask, in ascending order, as of the
+// start of every sub-block after the first, or UINT32_MAX for the sub-blocks which weren't written to)
+// NOTE: The seek table is within a seek table chunk which covers everything from the end of the last chunk of the block
+// up to the footer, so that it's skipped over by readers
+typedef struct {
+    // The streams which have offsets in the table
+    uint16_t stream_bitmask;
+    // Reserved for future use
+    uint16_t reserved;
+} seek_table_header_t;
+
+// On-disk checkpoint header type (occupies the first min_read_write_size bytes of the checkpoint region and is followed
+// by the lookup table values, the upper 16 bits of each block's object ID and then the version bitmap)
+// NOTE: Block numbers within the checkpoint region (in the tombstone) are stored as 16 bits unless the storage
+// has more than 65535 blocks, so the format doesn't depend on whether AFS is built with 32-bit block numbers
+typedef struct {
+    // Magic value
+    magic_value_t magic;
+    // Incremented every time a checkpoint is written
+    uint32_t generation;
+    // The block size of the storage which the checkpoint is for
+    uint32_t block_size;
+    // The number of blocks in the storage which the checkpoint is for
+    uint32_t num_blocks;
+    // The CRC32 of all the data which follows the header (the lookup table values, the upper 16 bits of each block's
+    // object ID and the version bitmap)
+    uint32_t checksum;
+} checkpoint_header_t;
+
+// On-disk tombstone header type (occupies the start of the last min_read_write_size bytes of the checkpoint region and
+// is followed by the list of first blocks of deleted objects which haven't been erased yet)
+typedef struct {
+    // Magic value
+    magic_value_t magic;
+    // The number of blocks in the list
+    uint16_t num_blocks;
+    // Reserved for future use
+    uint16_t reserved;
+    // The CRC32 of the list of blocks
+    uint32_t checksum;
+} tombstone_header_t;
+
 // On-disk chunk header type
 typedef struct {
     // The upper 8 bits are the type and the lower 24 are the length of data which follows the header
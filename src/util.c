@@ -12,7 +12,7 @@ bool util_is_block_header_valid(block_header_t* header, bool* is_v2) {
             *is_v2 = false;
         }
         return true;
-    } else if (header->magic.val == HEADER_MAGIC_VALUE_V2.val) {
+    } else if (header->magic.val == HEADER_MAGIC_VALUE_V2.val || header->magic.val == HEADER_MAGIC_VALUE_V3.val) {
         if (is_v2) {
             *is_v2 = true;
         }
@@ -22,6 +22,17 @@ bool util_is_block_header_valid(block_header_t* header, bool* is_v2) {
     }
 }
 
+uint32_t util_get_block_header_length(const block_header_t* header) {
+    return header->magic.val == HEADER_MAGIC_VALUE_V3.val ? sizeof(*header) : BLOCK_HEADER_V2_LENGTH;
+}
+
+afs_object_id_t util_get_block_header_object_id(const block_header_t* header) {
+    if (header->magic.val != HEADER_MAGIC_VALUE_V3.val) {
+        return header->object_id;
+    }
+    return (afs_object_id_t)header->object_id_high << 16 | header->object_id;
+}
+
 uint64_t util_get_stream_offset(const uint64_t* stream_offsets, uint8_t stream) {
     if (stream == AFS_WILDCARD_STREAM) {
         uint64_t offset = 0;
@@ -45,3 +56,19 @@ uint32_t util_get_block_offset(const uint32_t* block_offsets, uint8_t stream) {
         return block_offsets[stream];
     }
 }
+
+uint32_t util_crc32(uint32_t crc, const void* data, uint32_t length) {
+    // Use a nibble-wise table to keep the code size small while still being reasonably fast
+    static const uint32_t TABLE[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+    };
+    const uint8_t* data_ptr = data;
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data_ptr[i];
+        crc = (crc >> 4) ^ TABLE[crc & 0xf];
+        crc = (crc >> 4) ^ TABLE[crc & 0xf];
+    }
+    return ~crc;
+}
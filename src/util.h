@@ -1,5 +1,6 @@
 #pragma once
 
+#include "afs/afs.h"
 #include "storage_types.h"
 
 #include <stdbool.h>
@@ -37,11 +38,20 @@
         _tmp - (_tmp % _b); \
     })
 
-//! Returns whether or not a block header is valid
+//! Returns whether or not a block header is valid (AFS3 blocks count as v2 since they have the same block footer)
 bool util_is_block_header_valid(block_header_t* header, bool* is_v2);
 
+//! Gets the length of a valid block header on the storage
+uint32_t util_get_block_header_length(const block_header_t* header);
+
+//! Gets the full object ID from a valid block header
+afs_object_id_t util_get_block_header_object_id(const block_header_t* header);
+
 //! Gets the offset for a given stream from a list of stream offsets.
 uint64_t util_get_stream_offset(const uint64_t* stream_offsets, uint8_t stream);
 
 //! Gets the offset for a given stream from a list of block offsets.
 uint32_t util_get_block_offset(const uint32_t* block_offsets, uint8_t stream);
+
+//! Updates a CRC32 (IEEE 802.3) checksum with the specified data (the initial value should be 0)
+uint32_t util_crc32(uint32_t crc, const void* data, uint32_t length);
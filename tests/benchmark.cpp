@@ -0,0 +1,329 @@
+extern "C" {
+
+#include "afs/afs.h"
+#include "../src/storage_types.h"
+
+};
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#define READ_WRITE_SIZE               512
+#define BLOCK_SIZE                    (4 * 1024 * 1024)
+#define SUB_BLOCKS_PER_BLOCK          256
+#define BLOCKS_PER_OBJECT             8
+#define DELETED_OBJECT_INTERVAL       16
+#define NUM_ITERATIONS                3
+#define LATENCY_NUM_BLOCKS            4096
+#define LATENCY_US                    50
+#define SCAN_NUM_BLOCKS               65534
+#define SCAN_NUM_REPEATS              100
+#define SPARSE_BLOCKS_PER_OBJECT      1024
+
+static const uint16_t NUM_THREADS[] = {1, 2, 4, 8};
+
+static const afs_block_t NUM_BLOCKS[] = {8192, 32768, 65534};
+
+// The storage is simulated by generating block headers on the fly. Every object spans BLOCKS_PER_OBJECT consecutive
+// blocks, and every DELETED_OBJECT_INTERVAL'th object has been deleted (its first block is erased) to leave orphans.
+static void read_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  memset(buf, 0, length);
+  const uint16_t object_index = block / BLOCKS_PER_OBJECT;
+  const uint16_t object_block_index = block % BLOCKS_PER_OBJECT;
+  if (offset != 0 || (object_index % DELETED_OBJECT_INTERVAL == DELETED_OBJECT_INTERVAL - 1 && object_block_index == 0)) {
+    return;
+  }
+  const block_header_t header = {
+    .magic = HEADER_MAGIC_VALUE_V2,
+    .object_id = (uint16_t)(object_index + 1),
+    .object_block_index = object_block_index,
+  };
+  memcpy(buf, &header, BLOCK_HEADER_V2_LENGTH);
+}
+
+// Simulates storage with large objects which each span SPARSE_BLOCKS_PER_OBJECT consecutive blocks, so that first blocks
+// are sparse within the lookup table
+static void read_sparse_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  memset(buf, 0, length);
+  if (offset != 0) {
+    return;
+  }
+  const block_header_t header = {
+    .magic = HEADER_MAGIC_VALUE_V2,
+    .object_id = (uint16_t)(block / SPARSE_BLOCKS_PER_OBJECT + 1),
+    .object_block_index = (uint16_t)(block % SPARSE_BLOCKS_PER_OBJECT),
+  };
+  memcpy(buf, &header, BLOCK_HEADER_V2_LENGTH);
+}
+
+// Simulates storage where every read has a fixed latency (but can be serviced concurrently)
+static void read_latency_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  std::this_thread::sleep_for(std::chrono::microseconds(LATENCY_US));
+  read_func(buf, block, offset, length);
+}
+
+static void write_func(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+}
+
+static void erase_func(afs_block_t block) {
+}
+
+// The baseline algorithms are the lookup table's original full-table scans of one value at a time, kept here (rather
+// than in the library) for comparison. The values use the lookup table's layout: the object ID in the upper 16 bits and
+// the object block index in the lower 16 bits, with 0 being a free block.
+static void baseline_read_values(std::vector<uint32_t>& values, void (*read)(uint8_t*, afs_block_t, uint32_t, uint32_t)) {
+  uint8_t buf[READ_WRITE_SIZE];
+  for (size_t block = 0; block < values.size(); block++) {
+    read(buf, block, 0, READ_WRITE_SIZE);
+    block_header_t header;
+    memcpy(&header, buf, BLOCK_HEADER_V2_LENGTH);
+    values[block] = header.magic.val == HEADER_MAGIC_VALUE_V2.val ?
+        (((uint32_t)header.object_id << 16) | header.object_block_index) : 0;
+  }
+}
+
+// Frees the blocks of deleted objects by searching the entire table for the first block of each block's object
+static void baseline_remove_orphans(std::vector<uint32_t>& values) {
+  for (size_t block = 0; block < values.size(); block++) {
+    const uint32_t first_block_value = values[block] & 0xffff0000;
+    if (!first_block_value) {
+      continue;
+    }
+    bool found = false;
+    for (size_t i = 0; i < values.size() && !found; i++) {
+      found = values[i] == first_block_value;
+    }
+    if (!found) {
+      values[block] = 0;
+    }
+  }
+}
+
+static size_t baseline_list(const std::vector<uint32_t>& values) {
+  size_t num_objects = 0;
+  for (size_t block = 0; block < values.size(); block++) {
+    if ((values[block] >> 16) && !(values[block] & 0xffff)) {
+      num_objects++;
+    }
+  }
+  return num_objects;
+}
+
+static double benchmark_baseline_mount(afs_block_t num_blocks) {
+  std::vector<uint32_t> values(num_blocks);
+  double best_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    baseline_read_values(values, read_func);
+    baseline_remove_orphans(values);
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    best_ms = (i == 0 || duration.count() < best_ms) ? duration.count() : best_ms;
+  }
+  return best_ms;
+}
+
+static double benchmark_baseline_list(afs_block_t num_blocks, void (*read)(uint8_t*, afs_block_t, uint32_t, uint32_t)) {
+  std::vector<uint32_t> values(num_blocks);
+  baseline_read_values(values, read);
+  volatile size_t num_objects = 0;
+  double best_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < SCAN_NUM_REPEATS; j++) {
+      num_objects = num_objects + baseline_list(values);
+    }
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    const double list_ms = duration.count() / SCAN_NUM_REPEATS;
+    best_ms = (i == 0 || list_ms < best_ms) ? list_ms : best_ms;
+  }
+  return best_ms;
+}
+
+static double benchmark_mount(afs_block_t num_blocks) {
+  AFS_HANDLE_DEF(afs);
+  static uint8_t read_write_buffer[READ_WRITE_SIZE];
+  void* lookup_table_buffer = malloc(AFS_LOOKUP_TABLE_SIZE(num_blocks));
+  const afs_init_t init = {
+    .storage_config = {
+      .block_size = BLOCK_SIZE,
+      .num_blocks = num_blocks,
+      .sub_blocks_per_block = SUB_BLOCKS_PER_BLOCK,
+      .min_read_write_size = READ_WRITE_SIZE,
+      .read = read_func,
+      .write = write_func,
+      .erase = erase_func,
+    },
+    .read_write_buffer = read_write_buffer,
+    .lookup_table_buffer = lookup_table_buffer,
+  };
+  double best_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    afs_init(afs, &init);
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    afs_deinit(afs);
+    best_ms = (i == 0 || duration.count() < best_ms) ? duration.count() : best_ms;
+  }
+  free(lookup_table_buffer);
+  return best_ms;
+}
+
+static double benchmark_scans(afs_block_t num_blocks, double* delete_ms) {
+  AFS_HANDLE_DEF(afs);
+  static uint8_t read_write_buffer[READ_WRITE_SIZE];
+  void* lookup_table_buffer = malloc(AFS_LOOKUP_TABLE_SIZE(num_blocks));
+  const afs_init_t init = {
+    .storage_config = {
+      .block_size = BLOCK_SIZE,
+      .num_blocks = num_blocks,
+      .sub_blocks_per_block = SUB_BLOCKS_PER_BLOCK,
+      .min_read_write_size = READ_WRITE_SIZE,
+      .read = read_func,
+      .write = write_func,
+      .erase = erase_func,
+    },
+    .read_write_buffer = read_write_buffer,
+    .lookup_table_buffer = lookup_table_buffer,
+  };
+  double best_list_ms = 0;
+  double best_delete_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    afs_init(afs, &init);
+    // Listing the objects scans the entire lookup table for first blocks (repeated to get a measurable time)
+    auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < SCAN_NUM_REPEATS; j++) {
+      afs_object_list_entry_t entry = {};
+      while (afs_object_list(afs, &entry)) {}
+    }
+    const std::chrono::duration<double, std::milli> list_duration = std::chrono::steady_clock::now() - start;
+    // Deleting an object looks up each of its blocks via the index
+    start = std::chrono::steady_clock::now();
+    for (int j = 0; j < SCAN_NUM_REPEATS; j++) {
+      afs_object_delete(afs, j * DELETED_OBJECT_INTERVAL + 1);
+    }
+    const std::chrono::duration<double, std::milli> delete_duration = std::chrono::steady_clock::now() - start;
+    afs_deinit(afs);
+    const double list_ms = list_duration.count() / SCAN_NUM_REPEATS;
+    const double delete_ms = delete_duration.count() / SCAN_NUM_REPEATS;
+    best_list_ms = (i == 0 || list_ms < best_list_ms) ? list_ms : best_list_ms;
+    best_delete_ms = (i == 0 || delete_ms < best_delete_ms) ? delete_ms : best_delete_ms;
+  }
+  free(lookup_table_buffer);
+  *delete_ms = best_delete_ms;
+  return best_list_ms;
+}
+
+static double benchmark_sparse_list(afs_block_t num_blocks) {
+  AFS_HANDLE_DEF(afs);
+  static uint8_t read_write_buffer[READ_WRITE_SIZE];
+  void* lookup_table_buffer = malloc(AFS_LOOKUP_TABLE_SIZE(num_blocks));
+  const afs_init_t init = {
+    .storage_config = {
+      .block_size = BLOCK_SIZE,
+      .num_blocks = num_blocks,
+      .sub_blocks_per_block = SUB_BLOCKS_PER_BLOCK,
+      .min_read_write_size = READ_WRITE_SIZE,
+      .read = read_sparse_func,
+      .write = write_func,
+      .erase = erase_func,
+    },
+    .read_write_buffer = read_write_buffer,
+    .lookup_table_buffer = lookup_table_buffer,
+  };
+  double best_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    afs_init(afs, &init);
+    // Listing the objects skips over long runs of blocks which aren't first blocks (repeated to get a measurable time)
+    const auto start = std::chrono::steady_clock::now();
+    for (int j = 0; j < SCAN_NUM_REPEATS; j++) {
+      afs_object_list_entry_t entry = {};
+      while (afs_object_list(afs, &entry)) {}
+    }
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    afs_deinit(afs);
+    const double list_ms = duration.count() / SCAN_NUM_REPEATS;
+    best_ms = (i == 0 || list_ms < best_ms) ? list_ms : best_ms;
+  }
+  free(lookup_table_buffer);
+  return best_ms;
+}
+
+static double benchmark_parallel_mount(afs_block_t num_blocks, uint16_t num_threads) {
+  AFS_HANDLE_DEF(afs);
+  static uint8_t read_write_buffer[READ_WRITE_SIZE];
+  void* lookup_table_buffer = malloc(AFS_LOOKUP_TABLE_SIZE(num_blocks));
+  const afs_init_t init = {
+    .storage_config = {
+      .block_size = BLOCK_SIZE,
+      .num_blocks = num_blocks,
+      .sub_blocks_per_block = SUB_BLOCKS_PER_BLOCK,
+      .min_read_write_size = READ_WRITE_SIZE,
+      .read = read_latency_func,
+      .write = write_func,
+      .erase = erase_func,
+    },
+    .read_write_buffer = read_write_buffer,
+    .lookup_table_buffer = lookup_table_buffer,
+    .defer_mount = true,
+  };
+  std::vector<std::vector<uint8_t>> read_buffers(num_threads, std::vector<uint8_t>(READ_WRITE_SIZE));
+  const afs_block_t blocks_per_thread = (num_blocks / num_threads + 7) & ~7;
+  double best_ms = 0;
+  for (int i = 0; i < NUM_ITERATIONS; i++) {
+    const auto start = std::chrono::steady_clock::now();
+    afs_init(afs, &init);
+    std::vector<std::thread> threads;
+    for (uint16_t j = 0; j < num_threads; j++) {
+      const afs_block_t first_block = j * blocks_per_thread;
+      const afs_block_t thread_num_blocks = std::min<afs_block_t>(blocks_per_thread, num_blocks - first_block);
+      uint8_t* read_buffer = read_buffers[j].data();
+      threads.emplace_back([first_block, thread_num_blocks, read_buffer]() {
+        afs_mount_scan(afs, first_block, thread_num_blocks, read_buffer);
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    afs_mount_finish(afs);
+    const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+    afs_deinit(afs);
+    best_ms = (i == 0 || duration.count() < best_ms) ? duration.count() : best_ms;
+  }
+  free(lookup_table_buffer);
+  return best_ms;
+}
+
+int main(int argc, char **argv) {
+#if defined(__AVX2__)
+  printf("Lookup table: AVX2 scans\n");
+#elif defined(__SSE2__)
+  printf("Lookup table: SSE2 scans\n");
+#elif defined(__ARM_NEON)
+  printf("Lookup table: NEON scans\n");
+#else
+  printf("Lookup table: scans one value at a time\n");
+#endif
+  printf("Mount time:\n");
+  for (size_t i = 0; i < sizeof(NUM_BLOCKS) / sizeof(*NUM_BLOCKS); i++) {
+    printf("  num_blocks=%-6u %10.2f ms (baseline %10.2f ms)\n", NUM_BLOCKS[i], benchmark_mount(NUM_BLOCKS[i]),
+      benchmark_baseline_mount(NUM_BLOCKS[i]));
+  }
+  double delete_ms;
+  const double list_ms = benchmark_scans(SCAN_NUM_BLOCKS, &delete_ms);
+  const double baseline_list_ms = benchmark_baseline_list(SCAN_NUM_BLOCKS, read_func);
+  printf("Lookup table scans (num_blocks=%u):\n", SCAN_NUM_BLOCKS);
+  printf("  list objects     %10.3f ms (baseline %7.3f ms)\n", list_ms, baseline_list_ms);
+  printf("  delete object    %10.3f ms\n", delete_ms);
+  const double sparse_list_ms = benchmark_sparse_list(SCAN_NUM_BLOCKS);
+  const double baseline_sparse_list_ms = benchmark_baseline_list(SCAN_NUM_BLOCKS, read_sparse_func);
+  printf("  list objects (sparse) %5.3f ms (baseline %7.3f ms)\n", sparse_list_ms, baseline_sparse_list_ms);
+  printf("Parallel mount time (num_blocks=%u, read_latency=%uus):\n", LATENCY_NUM_BLOCKS, LATENCY_US);
+  for (size_t i = 0; i < sizeof(NUM_THREADS) / sizeof(*NUM_THREADS); i++) {
+    printf("  num_threads=%-5u %10.2f ms\n", NUM_THREADS[i], benchmark_parallel_mount(LATENCY_NUM_BLOCKS, NUM_THREADS[i]));
+  }
+  return 0;
+}
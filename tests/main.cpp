@@ -5,7 +5,11 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <mutex>
 #include <stdlib.h>
+#include <thread>
+#include <vector>
 
 static void randomize_write_data(void* buffer, size_t length) {
   while (length > 0) {
@@ -120,6 +124,50 @@ TEST_F(AFSFixture, ReadV1) {
   ASSERT_TRUE(afs_object_close(afs_, obj));
 }
 
+TEST_F(AFSFixture, ReadV2) {
+  // Manually create an object within the storage with an AFS2 block header (which only has a 16-bit object ID)
+  const uint16_t object_id = 0x1234;
+  uint8_t write_data[8];
+  randomize_write_data(write_data, sizeof(write_data));
+  test_storage_generate_v2_block(0, object_id, write_data, sizeof(write_data));
+
+  // Reinit AFS to pick up the new block
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  afs_init(afs_, &init_afs);
+  ASSERT_EQ(afs_size(afs_), 1);
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 1);
+
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+
+  // Open the object and verify for streams 1 and 2
+  for (uint8_t i = 1; i <= 2; i++) {
+    ASSERT_TRUE(afs_object_open(afs_, obj, i, object_id, &config));
+
+    // Verify the data
+    uint8_t read_data[sizeof(write_data)];
+    ASSERT_EQ(afs_object_read(afs_, obj, read_data, sizeof(read_data), NULL), sizeof(read_data));
+    ASSERT_DATA_MATCHES(read_data, write_data, sizeof(write_data));
+
+    // Make sure there's no more data to read
+    ASSERT_EQ(afs_object_read(afs_, obj, read_data, sizeof(read_data), NULL), 0);
+
+    // Close the object
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+
+  // Deleting the object should work the same as for objects with 32-bit object IDs
+  afs_object_delete(afs_, object_id);
+  ASSERT_EQ(afs_size(afs_), 0);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 1, object_id, &config));
+}
+
 // Verify a single write which fits both within a single block and within the caches
 TEST_F(AFSFixture, WriteSingleSmallChunk) {
   AFS_OBJECT_HANDLE_DEF(obj);
@@ -132,7 +180,7 @@ TEST_F(AFSFixture, WriteSingleSmallChunk) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write a single small chunk to the object
   ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
@@ -181,7 +229,7 @@ TEST_F(AFSFixture, WriteMultipleStreamsSmallChunk) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write a single small chunk between the two streams in an arbitrary order / pattern
   const uint8_t STREAM_PATTERN[] = {1, 1, 2, 1, 2, 2, 1};
@@ -246,7 +294,7 @@ TEST_F(AFSFixture, WriteSingleLargeChunk) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write a large chunk of data
   ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
@@ -258,11 +306,11 @@ TEST_F(AFSFixture, WriteSingleLargeChunk) {
   const uint8_t* exp_write_data;
   STORAGE_EXPECTATIONS_START();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_HEADER(object_id, 0);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data, 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data + 0x7fff4, 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, 0xfffe8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data + 0xfffe8, 0x18);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data + 0x7fff0, 0x7fff4);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, 0xfffe4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data + 0xfffe4, 0x1c);
   STORAGE_EXPECTATIONS_EXPECT_END_CHUNK();
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_UNTIL_FOOTER();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_FOOTER();
@@ -299,7 +347,7 @@ TEST_F(AFSFixture, WriteMultipleLargeChunks) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write a large chunk of data 10 times
   for (int i = 0; i < 10; i++) {
@@ -314,68 +362,68 @@ TEST_F(AFSFixture, WriteMultipleLargeChunks) {
   const uint32_t overflow_data_length2 = overflow_data_length1 + 0x30 + 0x80;
   STORAGE_EXPECTATIONS_START();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_HEADER(object_id, 0);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, (1 << 28) | 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fff4, 0x7fff4);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, (1 << 28) | 0xfffe8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xfffe8, 0x18);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7ffd8);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffd8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7ffd8, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffc8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xfffc8, 0x38);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7ffb4);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x17ffb4, (2 << 28) | 0x100000);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7ffb4, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x1fffa4, (2 << 28) | 0x100000);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xfffa4, 0x5c);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7ff90);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x17ff90);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7ff90, 0x7ff70);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, (1 << 28) | 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fff0, 0x7fff4);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, (1 << 28) | 0xfffe4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xfffe4, 0x1c);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7ffd4);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffd4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7ffd4, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffc4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xfffc4, 0x3c);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7ffb0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x17ffb0, (2 << 28) | 0x100000);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7ffb0, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x1fffa0, (2 << 28) | 0x100000);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xfffa0, 0x60);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7ff8c);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x17ff8c);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7ff8c, 0x7ff70);
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_FOOTER();
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x1fff00);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x1ffefc);
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_UNTIL_BLOCK_END();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_HEADER(object_id, 1);
-  STORAGE_EXPECTATIONS_EXPECT_OFFSET_CHUNK(2, (1ULL << 60) | 0x200000, (2ULL << 60) | 0x1fff00);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xfff00, 0x100);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fedc);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x7fedc, (2 << 28) | 0x100);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fedc, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0xffecc, (2 << 28) | 0x100);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffecc, 0x134);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7feb8);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffb8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7feb8, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffa8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffea8, 0x158);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fe94);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x17fe94, (2 << 28) | 0x100100);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fe94, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x1ffe84, (2 << 28) | 0x100100);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffe84, 0x17c);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7fe70);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x17ff70);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7fe70, 0x7ff70);
+  STORAGE_EXPECTATIONS_EXPECT_OFFSET_CHUNK(2, (1ULL << 60) | 0x200000, (2ULL << 60) | 0x1ffefc);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffefc, 0x104);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fed4);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x7fed4, (2 << 28) | 0x104);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fed4, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0xffec4, (2 << 28) | 0x104);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffec4, 0x13c);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7feb0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffb4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7feb0, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffa4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffea0, 0x160);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fe8c);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x17fe8c, (2 << 28) | 0x100104);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fe8c, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x1ffe7c, (2 << 28) | 0x100104);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffe7c, 0x184);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7fe68);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x17ff6c);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7fe68, 0x7ff70);
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_FOOTER();
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x1ffee0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x200000, (2 << 28) | 0x1ffedc);
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_UNTIL_BLOCK_END();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_HEADER(object_id, 2);
-  STORAGE_EXPECTATIONS_EXPECT_OFFSET_CHUNK(2, (1ULL << 60) | 0x400000, (2ULL << 60) | 0x3ffde0);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffde0, 0x220);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fdbc);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x7fdbc, (2 << 28) | 0x220);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fdbc, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0xffdac, (2 << 28) | 0x220);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffdac, 0x254);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7fd98);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffb8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7fd98, 0x7fff0);
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffa8);
-  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffd88, 0x278);
+  STORAGE_EXPECTATIONS_EXPECT_OFFSET_CHUNK(2, (1ULL << 60) | 0x400000, (2ULL << 60) | 0x3ffdd8);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffdd8, 0x228);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data, 0x7fdb0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x7fdb0, (2 << 28) | 0x228);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0x7fdb0, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0xffda0, (2 << 28) | 0x228);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(1, write_data + 0xffda0, 0x260);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data, 0x7fd8c);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x7ffb4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0x7fd8c, 0x7fff0);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0xfffa4);
+  STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(2, write_data + 0xffd7c, 0x284);
   STORAGE_EXPECTATIONS_EXPECT_END_CHUNK();
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_UNTIL_FOOTER();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_FOOTER();
-  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x100220);
+  STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(2, (1 << 28) | 0x100000, (2 << 28) | 0x100228);
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_UNTIL_BLOCK_END();
   STORAGE_EXPECTATIONS_END();
 
@@ -418,12 +466,12 @@ TEST_F(AFSFixture, EmptySpaceAtEndOfRegions) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write in the specific pattern to leave the desired empty space
   const uint32_t NUM_WRITES = 9;
   const uint32_t write_sizes[NUM_WRITES] = {
-    0x7fff0, // 1st sub-block - 4 bytes free
+    0x7ffec, // 1st sub-block - 4 bytes free
     0x7fff2, // 2nd sub-block - 2 bytes free
     0x7fff3, // 3rd sub-block - 1 byte free
     0x7fff4, // 4th sub-block - 0 bytes free
@@ -449,7 +497,7 @@ TEST_F(AFSFixture, EmptySpaceAtEndOfRegions) {
   STORAGE_EXPECTATIONS_START();
   STORAGE_EXPECTATIONS_EXPECT_BLOCK_HEADER(object_id, 0);
   STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data, write_sizes[0]);
-  STORAGE_EXPECTATIONS_EXPECT_UNUSED_BYTES(0x7fff4 - write_sizes[0]);
+  STORAGE_EXPECTATIONS_EXPECT_UNUSED_BYTES(0x7fff0 - write_sizes[0]);
   STORAGE_EXPECTATIONS_EXPECT_SEEK_CHUNK(1, cumulative_size[0]);
   STORAGE_EXPECTATIONS_EXPECT_DATA_CHUNK(0, write_data, write_sizes[1]);
   STORAGE_EXPECTATIONS_EXPECT_UNUSED_BYTES(0x7fff4 - write_sizes[1]);
@@ -516,13 +564,13 @@ TEST_F(AFSFixture, SmallDataAtEndOfBlock) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create the object
-  const uint16_t object_id = afs_object_create(afs_, obj, &config);
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
 
   // Write to the object in a way that we leave just enough empty space to fit a final 2 byte data chunk at the end of
   // the first block
   const uint32_t NUM_WRITES = 10;
   const uint32_t write_sizes[NUM_WRITES] = {
-    0x7fff4,
+    0x7fff0,
     0x7fff4,
     0x7fff4,
     0x7fff4,
@@ -609,7 +657,7 @@ TEST_F(AFSFixture, InsecureWipe) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create some objects which span multiple blocks
-  uint16_t object_ids[10];
+  afs_object_id_t object_ids[10];
   for (int i = 0; i < 5; i++) {
     object_ids[i] = afs_object_create(afs_, obj, &config);
     ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
@@ -650,7 +698,7 @@ TEST_F(AFSFixture, SecureWipe) {
   randomize_write_data(write_data, sizeof(write_data));
 
   // Create some objects which span multiple blocks
-  uint16_t object_ids[10];
+  afs_object_id_t object_ids[10];
   for (int i = 0; i < 5; i++) {
     object_ids[i] = afs_object_create(afs_, obj, &config);
     ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
@@ -675,6 +723,1444 @@ TEST_F(AFSFixture, SecureWipe) {
   STORAGE_EXPECTATIONS_END();
 }
 
+// Verify deleting objects frees their blocks without affecting other objects
+TEST_F(AFSFixture, DeleteObjects) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[5][1024*1024];
+  for (int i = 0; i < 5; i++) {
+    randomize_write_data(write_data[i], sizeof(write_data[i]));
+  }
+
+  // Create some objects which span multiple blocks
+  afs_object_id_t object_ids[5];
+  for (int i = 0; i < 5; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data[i], sizeof(write_data[i])));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 2);
+  }
+  ASSERT_EQ(afs_size(afs_), 10);
+
+  // Delete some of the objects
+  afs_object_delete(afs_, object_ids[1]);
+  afs_object_delete(afs_, object_ids[3]);
+  ASSERT_EQ(afs_size(afs_), 6);
+
+  // Create a new object which should reuse the freed blocks
+  object_ids[1] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 6; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data[1], sizeof(write_data[1])));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_size(afs_), 8);
+
+  for (int pass = 0; pass < 2; pass++) {
+    // Verify the deleted object is gone and the rest of the objects are intact
+    ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[3], &config));
+    for (int i = 0; i < 5; i++) {
+      if (i == 3) {
+        continue;
+      }
+      ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 2);
+      ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[i], &config));
+      ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data[i]) * 6);
+      ASSERT_TRUE(afs_object_seek(afs_, obj, sizeof(write_data[i]) * 5 + 0x1234));
+      uint32_t value;
+      ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+      uint32_t expect_value;
+      memcpy(&expect_value, &write_data[i][0x1234], sizeof(expect_value));
+      ASSERT_EQ(value, expect_value);
+      ASSERT_TRUE(afs_object_close(afs_, obj));
+    }
+
+    // Reinit AFS and make sure everything is the same after mounting
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    afs_init(afs_, &init_afs);
+    ASSERT_EQ(afs_size(afs_), 8);
+  }
+}
+
+// Verify that a checkpoint of the lookup table reduces the blocks read when mounting
+TEST_F(AFSFixture, Checkpoint) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Checkpoints aren't supported without a checkpoint region
+  ASSERT_FALSE(afs_checkpoint(afs_));
+
+  // Reinit AFS with a checkpoint region and return the number of block headers read while mounting
+  auto remount = [this]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_get_checkpoint_config(&init_afs.checkpoint_config);
+    const uint32_t start_num_reads = test_storage_get_num_block_header_reads();
+    afs_init(afs_, &init_afs);
+    return test_storage_get_num_block_header_reads() - start_num_reads;
+  };
+  const uint32_t num_blocks = remount();
+
+  // Create some objects which span multiple blocks
+  afs_object_id_t object_ids[4];
+  for (int i = 0; i < 3; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+
+  // Write a checkpoint while another object is still being written
+  object_ids[3] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 5; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_checkpoint(afs_));
+  ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_size(afs_), 8);
+
+  // Only the blocks which weren't part of a closed object at the time of the checkpoint should be read
+  ASSERT_EQ(remount(), num_blocks - 6);
+  ASSERT_EQ(afs_size(afs_), 8);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 2);
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[i], &config));
+    ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+
+  // Deleting an object should invalidate the checkpoint
+  afs_object_delete(afs_, object_ids[0]);
+  ASSERT_EQ(remount(), num_blocks);
+  ASSERT_EQ(afs_size(afs_), 6);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[0], &config));
+
+  // A corrupted checkpoint should be ignored
+  ASSERT_TRUE(afs_checkpoint(afs_));
+  test_storage_corrupt_checkpoint();
+  ASSERT_EQ(remount(), num_blocks);
+  ASSERT_EQ(afs_size(afs_), 6);
+
+  // Wiping should invalidate the checkpoint
+  ASSERT_TRUE(afs_checkpoint(afs_));
+  afs_wipe(afs_, false);
+  ASSERT_EQ(remount(), num_blocks);
+  ASSERT_EQ(afs_size(afs_), 0);
+}
+
+static std::mutex m_found_object_ids_mutex;
+static std::vector<afs_object_id_t> m_found_object_ids;
+
+static void object_found_callback(afs_object_id_t object_id, uint8_t stream, const uint8_t* data, uint32_t data_length) {
+  // This can be called from multiple threads when scanning in parallel
+  std::lock_guard<std::mutex> lock(m_found_object_ids_mutex);
+  m_found_object_ids.push_back(object_id);
+}
+
+// Verify that mounting with batched reads finds the same objects
+TEST_F(AFSFixture, MountBatchedReads) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Create some objects which span multiple blocks
+  std::vector<afs_object_id_t> object_ids;
+  for (int i = 0; i < 3; i++) {
+    object_ids.push_back(afs_object_create(afs_, obj, &config));
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+
+  // Reinit AFS without batched reads to get the number of blocks
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  uint32_t start_num_reads = test_storage_get_num_block_header_reads();
+  afs_init(afs_, &init_afs);
+  const uint32_t num_blocks = test_storage_get_num_block_header_reads() - start_num_reads;
+
+  // Reinit AFS with batched reads
+  afs_deinit(afs_);
+  test_storage_enable_read_multi(&init_afs);
+  init_afs.mount_callbacks.object_found = object_found_callback;
+  m_found_object_ids.clear();
+  start_num_reads = test_storage_get_num_block_header_reads();
+  afs_init(afs_, &init_afs);
+  ASSERT_EQ(test_storage_get_num_block_header_reads() - start_num_reads, num_blocks);
+  const uint32_t num_batches = (num_blocks + TEST_STORAGE_READ_MULTI_BATCH_SIZE - 1) / TEST_STORAGE_READ_MULTI_BATCH_SIZE;
+  ASSERT_EQ(test_storage_get_num_read_multi_calls(), num_batches);
+  std::sort(object_ids.begin(), object_ids.end());
+  std::sort(m_found_object_ids.begin(), m_found_object_ids.end());
+  ASSERT_EQ(m_found_object_ids, object_ids);
+
+  // Verify the objects
+  ASSERT_EQ(afs_size(afs_), 6);
+  for (const afs_object_id_t object_id : object_ids) {
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 2);
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+    ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+}
+
+// Verify that mounting by scanning ranges of blocks from multiple threads finds the same objects
+TEST_F(AFSFixture, MountParallelScan) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Create some objects which span multiple blocks and delete one of them to leave some orphaned blocks
+  std::vector<afs_object_id_t> object_ids;
+  for (int i = 0; i < 4; i++) {
+    object_ids.push_back(afs_object_create(afs_, obj, &config));
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  afs_object_delete(afs_, object_ids[1]);
+  object_ids.erase(object_ids.begin() + 1);
+
+  // Reinit AFS with a deferred mount and scan the blocks from multiple threads
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  init_afs.defer_mount = true;
+  init_afs.mount_callbacks.object_found = object_found_callback;
+  m_found_object_ids.clear();
+  afs_init(afs_, &init_afs);
+  const afs_block_t num_blocks = init_afs.storage_config.num_blocks;
+  const afs_block_t num_threads = 4;
+  const afs_block_t blocks_per_thread = (num_blocks / num_threads + 7) & ~7;
+  std::vector<std::vector<uint8_t>> read_buffers(num_threads, std::vector<uint8_t>(init_afs.storage_config.min_read_write_size));
+  std::vector<std::thread> threads;
+  for (afs_block_t i = 0; i < num_threads; i++) {
+    const afs_block_t first_block = i * blocks_per_thread;
+    const afs_block_t thread_num_blocks = std::min<afs_block_t>(blocks_per_thread, num_blocks - first_block);
+    uint8_t* read_buffer = read_buffers[i].data();
+    threads.emplace_back([this, first_block, thread_num_blocks, read_buffer]() {
+      afs_mount_scan(afs_, first_block, thread_num_blocks, read_buffer);
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  afs_mount_finish(afs_);
+
+  // Verify the objects
+  std::sort(object_ids.begin(), object_ids.end());
+  std::sort(m_found_object_ids.begin(), m_found_object_ids.end());
+  ASSERT_EQ(m_found_object_ids, object_ids);
+  ASSERT_EQ(afs_size(afs_), 6);
+  for (const afs_object_id_t object_id : object_ids) {
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 2);
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+    ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+}
+
+// Verify that the file system can be mounted incrementally
+TEST_F(AFSFixture, MountIncremental) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Create some objects which span multiple blocks
+  afs_object_id_t object_ids[3];
+  for (int i = 0; i < 3; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+
+  // Reinit AFS with a deferred mount, which shouldn't read anything
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  init_afs.defer_mount = true;
+  uint32_t start_num_reads = test_storage_get_num_block_header_reads();
+  afs_init(afs_, &init_afs);
+  ASSERT_EQ(test_storage_get_num_block_header_reads(), start_num_reads);
+
+  // Mount a few blocks at a time
+  const uint16_t max_blocks = 10;
+  uint32_t num_steps = 0;
+  while (true) {
+    start_num_reads = test_storage_get_num_block_header_reads();
+    const bool is_done = afs_mount_step(afs_, max_blocks);
+    ASSERT_LE(test_storage_get_num_block_header_reads() - start_num_reads, max_blocks);
+    num_steps++;
+    if (is_done) {
+      break;
+    }
+  }
+  ASSERT_EQ(num_steps, (init_afs.storage_config.num_blocks + max_blocks - 1) / max_blocks);
+  ASSERT_TRUE(afs_mount_step(afs_, max_blocks));
+  ASSERT_EQ(afs_size(afs_), 6);
+
+  // Reinit AFS with a deferred mount and make sure it finishes mounting as soon as the lookup table is needed
+  afs_deinit(afs_);
+  afs_init(afs_, &init_afs);
+  ASSERT_FALSE(afs_mount_step(afs_, max_blocks));
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[1], &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_TRUE(afs_mount_step(afs_, max_blocks));
+  ASSERT_EQ(afs_size(afs_), 6);
+}
+
+// Verify that repeated seeks hit the metadata cache
+TEST_F(AFSFixture, MetadataCache) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  for (uint32_t i = 0; i < sizeof(write_data) / sizeof(uint32_t); i++) {
+    memcpy(&write_data[i * sizeof(uint32_t)], &i, sizeof(i));
+  }
+
+  // Reinit AFS with a metadata cache
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  test_storage_enable_metadata_cache(&init_afs);
+  afs_init(afs_, &init_afs);
+
+  // Create an object which spans multiple blocks
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 10; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 3);
+
+  // Seek around the object and get its size a couple of times
+  afs_stats_t stats[3];
+  afs_get_stats(afs_, &stats[0]);
+  for (int pass = 0; pass < 2; pass++) {
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+    ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 10);
+    for (const uint32_t offset : {0x8f1234, 0x1234, 0x5f4320, 0x7c0000}) {
+      afs_read_position_t start_pos;
+      afs_object_save_read_position(afs_, obj, &start_pos);
+      ASSERT_TRUE(afs_object_seek(afs_, obj, offset));
+      uint32_t value;
+      ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+      ASSERT_EQ(value, (offset % sizeof(write_data)) / sizeof(uint32_t));
+      afs_object_restore_read_position(afs_, obj, &start_pos);
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+    afs_get_stats(afs_, &stats[pass + 1]);
+  }
+
+  // The first pass should have needed to read from the storage, but the second pass should have been fully cached
+  ASSERT_GT(stats[1].metadata_cache_misses, stats[0].metadata_cache_misses);
+  ASSERT_EQ(stats[2].metadata_cache_misses, stats[1].metadata_cache_misses);
+  ASSERT_GT(stats[2].metadata_cache_hits, stats[1].metadata_cache_hits);
+
+  // Writing a new object shouldn't leave stale data in the cache
+  const afs_object_id_t object_id2 = afs_object_create(afs_, obj, &config);
+  ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  afs_object_delete(afs_, object_id);
+  const afs_object_id_t object_id3 = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 10; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  for (const afs_object_id_t id : {object_id2, object_id3}) {
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, id, &config));
+    const uint64_t size = afs_object_size(afs_, obj, 0);
+    ASSERT_EQ(size, sizeof(write_data) * (id == object_id2 ? 1 : 10));
+    ASSERT_TRUE(afs_object_seek(afs_, obj, size - sizeof(uint32_t)));
+    uint32_t value;
+    ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+    ASSERT_EQ(value, sizeof(write_data) / sizeof(uint32_t) - 1);
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+}
+
+// Verify that blocks are looked up via the extent table until they're too fragmented for it to fit
+TEST_F(AFSFixture, LookupTableExtents) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  AFS_OBJECT_HANDLE_DEF(obj2);
+  static uint8_t buffer[2][1024];
+  const afs_object_config_t config[2] = {
+    {.buffer = buffer[0], .buffer_size = sizeof(buffer[0])},
+    {.buffer = buffer[1], .buffer_size = sizeof(buffer[1])},
+  };
+  static uint32_t write_data[1024 * 1024 / sizeof(uint32_t)];
+  auto fill_write_data = [&](uint32_t object_index, uint32_t chunk_index) {
+    for (uint32_t i = 0; i < sizeof(write_data) / sizeof(uint32_t); i++) {
+      write_data[i] = (object_index << 28) | (chunk_index << 18) | i;
+    }
+  };
+  auto reinit = [&]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_enable_lookup_table_extents(&init_afs, 4);
+    afs_init(afs_, &init_afs);
+  };
+  auto get_num_extents = [&]() {
+    afs_stats_t stats;
+    afs_get_stats(afs_, &stats);
+    return stats.num_lookup_table_extents;
+  };
+  std::vector<afs_object_id_t> object_ids;
+  auto verify_objects = [&]() {
+    for (uint32_t i = 0; i < object_ids.size(); i++) {
+      if (object_ids[i] == INVALID_OBJECT_ID) {
+        continue;
+      }
+      ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 3);
+      ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[i], &config[0]));
+      ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 10);
+      for (const uint32_t chunk_index : {9, 0, 4, 7}) {
+        afs_read_position_t start_pos;
+        afs_object_save_read_position(afs_, obj, &start_pos);
+        ASSERT_TRUE(afs_object_seek(afs_, obj, chunk_index * sizeof(write_data) + sizeof(uint32_t)));
+        uint32_t value;
+        ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+        ASSERT_EQ(value, (i << 28) | (chunk_index << 18) | 1);
+        afs_object_restore_read_position(afs_, obj, &start_pos);
+      }
+      ASSERT_TRUE(afs_object_close(afs_, obj));
+    }
+  };
+
+  // Reinit AFS with room for 4 extents
+  reinit();
+
+  // Objects which are written one at a time each occupy a single extent
+  for (uint32_t i = 0; i < 3; i++) {
+    object_ids.push_back(afs_object_create(afs_, obj, &config[0]));
+    for (uint32_t j = 0; j < 10; j++) {
+      fill_write_data(i, j);
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, (const uint8_t*)write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  ASSERT_EQ(get_num_extents(), 3);
+  verify_objects();
+
+  // The extents should be rebuilt when mounting
+  reinit();
+  ASSERT_EQ(get_num_extents(), 3);
+  verify_objects();
+
+  // Deleting an object should remove its extent
+  afs_object_delete(afs_, object_ids[1]);
+  object_ids[1] = INVALID_OBJECT_ID;
+  ASSERT_EQ(get_num_extents(), 2);
+  verify_objects();
+
+  // Writing two objects at once interleaves their blocks, which needs more extents than there's room for, so the
+  // lookup table should fall back to the hash index
+  object_ids.push_back(afs_object_create(afs_, obj, &config[0]));
+  object_ids.push_back(afs_object_create(afs_, obj2, &config[1]));
+  for (uint32_t j = 0; j < 10; j++) {
+    fill_write_data(3, j);
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, (const uint8_t*)write_data, sizeof(write_data)));
+    fill_write_data(4, j);
+    ASSERT_TRUE(afs_object_write(afs_, obj2, 0, (const uint8_t*)write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_TRUE(afs_object_close(afs_, obj2));
+  ASSERT_EQ(get_num_extents(), 0);
+  verify_objects();
+
+  // The same should happen when mounting
+  reinit();
+  ASSERT_EQ(get_num_extents(), 0);
+  verify_objects();
+}
+
+// Verify that large reads go directly into the caller's buffer
+TEST_F(AFSFixture, DirectRead) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  for (uint32_t i = 0; i < sizeof(write_data); i++) {
+    write_data[i] = rand();
+  }
+
+  // Create an object which spans multiple blocks with data in two streams
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 5; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    ASSERT_TRUE(afs_object_write(afs_, obj, 1, write_data, 1234));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_GT(afs_object_get_num_blocks(afs_, object_id), 1);
+
+  // Read the object back in large pieces which don't line up with the storage
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+  static uint8_t read_data[sizeof(write_data)];
+  for (int j = 0; j < 5; j++) {
+    uint32_t offset = 0;
+    while (offset < sizeof(read_data)) {
+      const uint32_t read_length = std::min<uint32_t>(sizeof(read_data) - offset, 100000);
+      ASSERT_EQ(afs_object_read(afs_, obj, &read_data[offset], read_length, NULL), read_length);
+      offset += read_length;
+    }
+    ASSERT_DATA_MATCHES(read_data, write_data, sizeof(write_data));
+  }
+  uint8_t value;
+  ASSERT_EQ(afs_object_read(afs_, obj, &value, sizeof(value), NULL), 0);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+
+  // The reads should have bypassed the object's buffer
+  ASSERT_GT(test_storage_get_max_read_length(), sizeof(buffer));
+}
+
+// Verify that large writes go directly from the caller's buffer
+TEST_F(AFSFixture, DirectWrite) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[5 * 1024 * 1024];
+  for (uint32_t i = 0; i < sizeof(write_data); i++) {
+    write_data[i] = rand();
+  }
+
+  // Create an object which spans multiple blocks using writes which don't line up with the storage
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
+  const uint32_t write_lengths[] = {1, 4093, 65536, 300001, 1000000};
+  uint32_t offset = 0;
+  for (int i = 0; offset < sizeof(write_data); i++) {
+    const uint32_t write_length = std::min<uint32_t>(write_lengths[i % 5], sizeof(write_data) - offset);
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, &write_data[offset], write_length));
+    offset += write_length;
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 2);
+
+  // The writes should have bypassed the object's buffer
+  ASSERT_GT(test_storage_get_max_write_length(), sizeof(buffer));
+
+  // Read the object back and verify it
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data));
+  static uint8_t read_data[sizeof(write_data)];
+  ASSERT_EQ(afs_object_read(afs_, obj, read_data, sizeof(read_data), NULL), sizeof(read_data));
+  ASSERT_DATA_MATCHES(read_data, write_data, sizeof(write_data));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+}
+
+TEST_F(AFSFixture, AsyncWrite) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  static uint8_t async_buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+    .async_buffer = async_buffer,
+  };
+  static uint8_t write_data[5 * 1024 * 1024];
+  for (uint32_t i = 0; i < sizeof(write_data); i++) {
+    write_data[i] = rand();
+  }
+
+  // Reinit AFS with asynchronous writes
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  test_storage_enable_write_async(&init_afs);
+  afs_init(afs_, &init_afs);
+
+  // Create an object which spans multiple blocks using a mix of writes which do and don't go through the buffers
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
+  const uint32_t write_lengths[] = {100, 3000, 77, 70000};
+  uint32_t offset = 0;
+  for (int i = 0; offset < sizeof(write_data); i++) {
+    const uint32_t write_length = std::min<uint32_t>(write_lengths[i % 4], sizeof(write_data) - offset);
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, &write_data[offset], write_length));
+    offset += write_length;
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 2);
+
+  // The buffered writes should have happened in the background and been complete by the time the object was closed
+  ASSERT_GT(test_storage_get_num_async_writes(), 0);
+  ASSERT_FALSE(test_storage_is_async_write_pending());
+
+  // Read the object back and verify it
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data));
+  static uint8_t read_data[sizeof(write_data)];
+  ASSERT_EQ(afs_object_read(afs_, obj, read_data, sizeof(read_data), NULL), sizeof(read_data));
+  ASSERT_DATA_MATCHES(read_data, write_data, sizeof(write_data));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+}
+
+TEST_F(AFSFixture, ReadAhead) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  static uint8_t async_buffer[1024];
+  const afs_object_config_t sync_config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  const afs_object_config_t async_config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+    .async_buffer = async_buffer,
+  };
+  static uint8_t write_data[2][5 * 1024 * 1024];
+  for (uint32_t i = 0; i < sizeof(write_data[0]); i++) {
+    write_data[0][i] = rand();
+    write_data[1][i] = rand();
+  }
+
+  // Reinit AFS with asynchronous reads
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  test_storage_enable_read_async(&init_afs);
+  afs_init(afs_, &init_afs);
+
+  // Create an object which spans multiple blocks with small chunks of stream 0 between large chunks of stream 1
+  const uint32_t stream_lengths[2] = {100, 20000};
+  const uint32_t num_chunks = 250;
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &sync_config);
+  for (uint32_t i = 0; i < num_chunks; i++) {
+    for (uint8_t stream = 0; stream < 2; stream++) {
+      const uint32_t length = stream_lengths[stream];
+      ASSERT_TRUE(afs_object_write(afs_, obj, stream, &write_data[stream][i * length], length));
+    }
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id), 2);
+
+  // Read stream 0 back without reading ahead
+  static uint8_t read_data[2][sizeof(write_data[0])];
+  const uint64_t sync_start_bytes_read = test_storage_get_num_bytes_read();
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &sync_config));
+  for (uint32_t i = 0; i < num_chunks; i++) {
+    ASSERT_EQ(afs_object_read(afs_, obj, &read_data[0][i * stream_lengths[0]], stream_lengths[0], NULL), stream_lengths[0]);
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_DATA_MATCHES(read_data[0], write_data[0], num_chunks * stream_lengths[0]);
+  const uint64_t sync_bytes_read = test_storage_get_num_bytes_read() - sync_start_bytes_read;
+  ASSERT_EQ(test_storage_get_num_async_reads(), 0);
+
+  // Read stream 0 back while reading ahead, which shouldn't read any of the stream 1 data which the reader skips
+  memset(read_data, 0, sizeof(read_data));
+  const uint64_t async_start_bytes_read = test_storage_get_num_bytes_read();
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id, &async_config));
+  for (uint32_t i = 0; i < num_chunks; i++) {
+    ASSERT_EQ(afs_object_read(afs_, obj, &read_data[0][i * stream_lengths[0]], stream_lengths[0], NULL), stream_lengths[0]);
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_FALSE(test_storage_is_async_read_pending());
+  ASSERT_DATA_MATCHES(read_data[0], write_data[0], num_chunks * stream_lengths[0]);
+  ASSERT_LE(test_storage_get_num_bytes_read() - async_start_bytes_read, sync_bytes_read);
+
+  // Read both streams back in small pieces while reading ahead, crossing into the second block
+  memset(read_data, 0, sizeof(read_data));
+  const uint32_t prev_num_async_reads = test_storage_get_num_async_reads();
+  const uint64_t wildcard_start_bytes_read = test_storage_get_num_bytes_read();
+  ASSERT_TRUE(afs_object_open(afs_, obj, AFS_WILDCARD_STREAM, object_id, &async_config));
+  uint32_t read_offsets[2] = {0, 0};
+  while (true) {
+    uint8_t stream;
+    uint8_t data[100];
+    const uint32_t read_bytes = afs_object_read(afs_, obj, data, sizeof(data), &stream);
+    if (!read_bytes) {
+      break;
+    }
+    ASSERT_LT(stream, 2);
+    memcpy(&read_data[stream][read_offsets[stream]], data, read_bytes);
+    read_offsets[stream] += read_bytes;
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_FALSE(test_storage_is_async_read_pending());
+  for (uint8_t stream = 0; stream < 2; stream++) {
+    ASSERT_EQ(read_offsets[stream], num_chunks * stream_lengths[stream]);
+    ASSERT_DATA_MATCHES(read_data[stream], write_data[stream], read_offsets[stream]);
+  }
+  // Almost all of the reads should have been done ahead of time in the background
+  const uint64_t wildcard_bytes_read = test_storage_get_num_bytes_read() - wildcard_start_bytes_read;
+  ASSERT_GT(test_storage_get_num_async_reads() - prev_num_async_reads, wildcard_bytes_read / sizeof(buffer) * 9 / 10);
+}
+
+TEST_F(AFSFixture, ErasePool) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Reinit AFS with a pool of erased blocks
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  init_afs.erase_pool_low_water_mark = 4;
+  afs_init(afs_, &init_afs);
+
+  // Fill the pool over a few calls
+  ASSERT_FALSE(afs_maintenance(afs_, 3));
+  ASSERT_TRUE(afs_maintenance(afs_, 3));
+  ASSERT_TRUE(afs_maintenance(afs_, 3));
+
+  // Create an object which uses all the blocks in the pool, which shouldn't erase anything inline
+  const afs_object_id_t object_id1 = afs_object_create(afs_, obj, &config);
+  for (int i = 0; i < 14; i++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id1), 4);
+  afs_stats_t stats;
+  afs_get_stats(afs_, &stats);
+  ASSERT_EQ(stats.num_inline_erases, 0);
+
+  // Create another object without refilling the pool, which needs to erase inline
+  const afs_object_id_t object_id2 = afs_object_create(afs_, obj, &config);
+  for (int i = 0; i < 6; i++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id2), 2);
+  afs_get_stats(afs_, &stats);
+  ASSERT_EQ(stats.num_inline_erases, 2);
+}
+
+static uint32_t m_time_us;
+
+static uint32_t get_time_us(void) {
+  // Advance the time on every call
+  m_time_us += 100;
+  return m_time_us;
+}
+
+TEST_F(AFSFixture, IdleWork) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Reinit AFS with a checkpoint region, a clock and a pool of erased blocks and return the number of block headers
+  // read while mounting
+  auto remount = [this]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_get_checkpoint_config(&init_afs.checkpoint_config);
+    init_afs.erase_pool_low_water_mark = 2;
+    init_afs.get_time_us = get_time_us;
+    const uint32_t start_num_reads = test_storage_get_num_block_header_reads();
+    afs_init(afs_, &init_afs);
+    return test_storage_get_num_block_header_reads() - start_num_reads;
+  };
+  const uint32_t num_blocks = remount();
+
+  // Create some objects and then delete one of them so that there are some garbage blocks
+  afs_object_id_t object_ids[3];
+  const int num_writes[3] = {10, 6, 10};
+  for (int i = 0; i < 2; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < num_writes[i]; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[0]), 3);
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[1]), 2);
+  afs_object_delete(afs_, object_ids[0]);
+  afs_stats_t stats;
+  afs_get_stats(afs_, &stats);
+  ASSERT_EQ(stats.num_inline_erases, 5);
+
+  // The work should stop once the budget runs out
+  const uint32_t start_num_erases = test_storage_get_num_erases();
+  ASSERT_FALSE(afs_idle_work(afs_, 0, 1000));
+  ASSERT_FALSE(afs_idle_work(afs_, 1, 0));
+
+  // Finish the work, which should erase every free block other than the first block of the deleted object (which was
+  // already erased by the delete) and the two blocks of the remaining object
+  while (!afs_idle_work(afs_, 1000, 0)) {}
+  ASSERT_EQ(test_storage_get_num_erases() - start_num_erases, num_blocks - 3);
+  ASSERT_TRUE(afs_idle_work(afs_, 1, 0));
+
+  // Creating another object shouldn't need to erase anything inline
+  object_ids[2] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < num_writes[2]; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[2]), 3);
+  afs_get_stats(afs_, &stats);
+  ASSERT_EQ(stats.num_inline_erases, 5);
+
+  // The idle work should write a checkpoint since the lookup table changed, so the next mount skips the used blocks
+  ASSERT_TRUE(afs_idle_work(afs_, 0, 0));
+  ASSERT_EQ(remount(), num_blocks - 5);
+  ASSERT_EQ(afs_size(afs_), 5);
+}
+
+TEST_F(AFSFixture, DeferredDelete) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Without a checkpoint region, the first block needs to be erased right away
+  afs_object_id_t object_ids[4];
+  object_ids[0] = afs_object_create(afs_, obj, &config);
+  ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  uint32_t start_num_erases = test_storage_get_num_erases();
+  afs_object_delete_deferred(afs_, object_ids[0]);
+  ASSERT_EQ(test_storage_get_num_erases() - start_num_erases, 1);
+
+  // Reinit AFS with a checkpoint region (which holds the tombstone)
+  auto remount = [this]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_get_checkpoint_config(&init_afs.checkpoint_config);
+    afs_init(afs_, &init_afs);
+  };
+  remount();
+
+  // Create some objects which span multiple blocks
+  for (int i = 0; i < 3; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  ASSERT_EQ(afs_size(afs_), 6);
+
+  // Deleting objects shouldn't erase anything, or write the tombstone until it's needed
+  start_num_erases = test_storage_get_num_erases();
+  const uint32_t start_num_bytes = test_storage_get_num_checkpoint_bytes_written();
+  afs_object_delete_deferred(afs_, object_ids[0]);
+  afs_object_delete_deferred(afs_, object_ids[1]);
+  ASSERT_EQ(test_storage_get_num_erases(), start_num_erases);
+  ASSERT_EQ(test_storage_get_num_checkpoint_bytes_written(), start_num_bytes);
+  ASSERT_EQ(afs_size(afs_), 2);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[0], &config));
+
+  // The objects should still be deleted after remounting, with the tombstone written once for both of them
+  remount();
+  ASSERT_EQ(test_storage_get_num_checkpoint_bytes_written() - start_num_bytes, 512);
+  ASSERT_EQ(afs_size(afs_), 2);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[0], &config));
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[1], &config));
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[2], &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+
+  // The idle work should erase the first blocks of the deleted objects
+  start_num_erases = test_storage_get_num_erases();
+  ASSERT_TRUE(afs_idle_work(afs_, 0, 0));
+  ASSERT_GE(test_storage_get_num_erases() - start_num_erases, 2);
+
+  // Blocks which are reused after being erased shouldn't be affected by the old tombstone
+  object_ids[3] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 6; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  remount();
+  ASSERT_EQ(afs_size(afs_), 4);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[0], &config));
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[1], &config));
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[2]), 2);
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[3]), 2);
+
+  // A secure wipe should also erase the first blocks of deleted objects which haven't been erased yet, and remove them
+  // from the tombstone (so that remounting doesn't find any stale entries to remove)
+  ASSERT_TRUE(afs_idle_work(afs_, 0, 0));
+  object_ids[0] = afs_object_create(afs_, obj, &config);
+  ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, 1024));
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  afs_object_delete_deferred(afs_, object_ids[0]);
+  afs_wipe(afs_, true);
+  STORAGE_EXPECTATIONS_START();
+  STORAGE_EXPECTATIONS_END();
+  remount();
+  ASSERT_EQ(afs_size(afs_), 0);
+  const uint32_t wiped_num_bytes = test_storage_get_num_checkpoint_bytes_written();
+  remount();
+  ASSERT_EQ(test_storage_get_num_checkpoint_bytes_written(), wiped_num_bytes);
+}
+
+static void (*m_checkpoint_write)(const uint8_t* buf, uint32_t offset, uint32_t length);
+static bool m_drop_tombstone_writes;
+
+static void checkpoint_write_func(const uint8_t* buf, uint32_t offset, uint32_t length) {
+  if (m_drop_tombstone_writes && !memcmp(buf, "afsd", 4)) {
+    // Simulate losing power before the tombstone was written
+    return;
+  }
+  m_checkpoint_write(buf, offset, length);
+}
+
+TEST_F(AFSFixture, DeferredDeleteInterrupted) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Reinit AFS with a checkpoint region (which holds the tombstone)
+  auto remount = [this]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_get_checkpoint_config(&init_afs.checkpoint_config);
+    m_checkpoint_write = init_afs.checkpoint_config.write;
+    init_afs.checkpoint_config.write = checkpoint_write_func;
+    afs_init(afs_, &init_afs);
+  };
+  m_drop_tombstone_writes = false;
+  remount();
+
+  // Create an object and delete it, with the deletion recorded in the tombstone
+  afs_object_id_t object_ids[2];
+  object_ids[0] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 6; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  afs_object_delete_deferred(afs_, object_ids[0]);
+  remount();
+  ASSERT_EQ(afs_size(afs_), 0);
+
+  // Erase the first block of the deleted object, but lose power before the tombstone is updated
+  m_drop_tombstone_writes = true;
+  ASSERT_FALSE(afs_idle_work(afs_, 1, 0));
+  m_drop_tombstone_writes = false;
+  remount();
+  ASSERT_EQ(afs_size(afs_), 0);
+
+  // A new object which reuses the erased block shouldn't be deleted by the stale tombstone entry
+  object_ids[1] = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 6; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  remount();
+  ASSERT_EQ(afs_size(afs_), 2);
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[1], &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+}
+
+TEST_F(AFSFixture, DeleteMany) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Reinit AFS with a checkpoint region (which holds the tombstone)
+  auto remount = [this]() {
+    afs_deinit(afs_);
+    afs_init_t init_afs;
+    test_storage_get_afs_init(&init_afs);
+    test_storage_get_checkpoint_config(&init_afs.checkpoint_config);
+    afs_init(afs_, &init_afs);
+  };
+  remount();
+
+  // Create some objects which span multiple blocks
+  afs_object_id_t object_ids[6];
+  for (int i = 0; i < 6; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  ASSERT_EQ(afs_size(afs_), 12);
+
+  // Delete one of the objects with its erase deferred
+  const uint32_t start_num_erases = test_storage_get_num_erases();
+  afs_object_delete_deferred(afs_, object_ids[5]);
+  ASSERT_EQ(afs_size(afs_), 10);
+
+  // Delete some of the objects together (including a duplicate), which should only erase their first blocks and leave
+  // the deferred one alone
+  const afs_object_id_t delete_object_ids[] = {object_ids[1], object_ids[3], object_ids[4], object_ids[3]};
+  afs_object_delete_many(afs_, delete_object_ids, sizeof(delete_object_ids) / sizeof(delete_object_ids[0]));
+  ASSERT_EQ(test_storage_get_num_erases() - start_num_erases, 3);
+  ASSERT_EQ(afs_size(afs_), 4);
+
+  for (int pass = 0; pass < 2; pass++) {
+    // Verify the deleted objects are gone and the rest of the objects are intact
+    for (int i = 0; i < 6; i++) {
+      if (i == 1 || i == 3 || i == 4 || i == 5) {
+        ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_ids[i], &config));
+        continue;
+      }
+      ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 2);
+      ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[i], &config));
+      ASSERT_EQ(afs_object_size(afs_, obj, 0), sizeof(write_data) * 6);
+      ASSERT_TRUE(afs_object_close(afs_, obj));
+    }
+
+    // Reinit AFS and make sure everything is the same after mounting
+    remount();
+    ASSERT_EQ(afs_size(afs_), 4);
+  }
+}
+
+TEST_F(AFSFixture, EraseRange) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Reinit AFS with support for erasing ranges of blocks
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  test_storage_enable_erase_range(&init_afs);
+  afs_init(afs_, &init_afs);
+
+  // Create some objects which span multiple blocks (which will use adjacent blocks)
+  for (int i = 0; i < 5; i++) {
+    afs_object_create(afs_, obj, &config);
+    for (int j = 0; j < 6; j++) {
+      ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  ASSERT_EQ(afs_size(afs_), 10);
+
+  // A secure wipe should erase all the blocks with a single range
+  const uint32_t start_num_erases = test_storage_get_num_erases();
+  afs_wipe(afs_, true);
+  ASSERT_EQ(afs_size(afs_), 0);
+  ASSERT_EQ(test_storage_get_num_erase_ranges(), 1);
+  ASSERT_EQ(test_storage_get_num_erases(), start_num_erases);
+
+  // Preparing the storage should also erase the blocks with a single range
+  afs_prepare_storage(afs_, 30);
+  ASSERT_EQ(test_storage_get_num_erase_ranges(), 2);
+  ASSERT_EQ(test_storage_get_num_erases(), start_num_erases);
+
+  // Deleting adjacent objects should erase their first blocks together, while a lone block is erased by itself
+  afs_object_id_t object_ids[4];
+  for (int i = 0; i < 4; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, &config);
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, 1024));
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+  const afs_object_id_t delete_object_ids[] = {object_ids[0], object_ids[1], object_ids[3]};
+  afs_object_delete_many(afs_, delete_object_ids, sizeof(delete_object_ids) / sizeof(delete_object_ids[0]));
+  ASSERT_EQ(test_storage_get_num_erase_ranges(), 3);
+  ASSERT_EQ(test_storage_get_num_erases(), start_num_erases + 1);
+  ASSERT_EQ(afs_size(afs_), 1);
+  ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_ids[2], &config));
+  ASSERT_EQ(afs_object_size(afs_, obj, 0), 1024);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+}
+
+TEST_F(AFSFixture, Usage) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  static uint8_t write_data[1024*1024];
+  randomize_write_data(write_data, sizeof(write_data));
+
+  // Nothing is in use or known to be erased after mounting empty storage
+  afs_usage_t usage;
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_blocks, 256);
+  ASSERT_EQ(usage.num_used_blocks, 0);
+  ASSERT_EQ(usage.num_free_blocks, 256);
+  ASSERT_EQ(usage.num_erased_blocks, 0);
+  ASSERT_EQ(usage.num_garbage_blocks, 0);
+
+  // Create an object which spans multiple blocks
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &config);
+  for (int j = 0; j < 6; j++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data, sizeof(write_data)));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_used_blocks, 2);
+  ASSERT_EQ(usage.num_used_blocks, afs_size(afs_));
+  ASSERT_EQ(usage.num_free_blocks, 254);
+
+  // Deleting the object erases its first block and leaves the other one as garbage
+  afs_object_delete(afs_, object_id);
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_used_blocks, 0);
+  ASSERT_EQ(usage.num_free_blocks, 256);
+  ASSERT_EQ(usage.num_erased_blocks, 1);
+  ASSERT_EQ(usage.num_garbage_blocks, 1);
+
+  // Preparing the storage erases more blocks
+  afs_prepare_storage(afs_, 10);
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_erased_blocks, 10);
+  ASSERT_EQ(usage.num_free_blocks, 256);
+
+  // The counts should be the same after remounting
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  afs_init(afs_, &init_afs);
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_used_blocks, 0);
+  ASSERT_EQ(usage.num_free_blocks, 256);
+  ASSERT_FALSE(afs_is_storage_full(afs_));
+}
+
+TEST_F(AFSFixture, ObjectIds) {
+  static uint8_t buffer[1024];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+
+  // Objects which are created at the same time should get unique object IDs even though nothing has been written yet
+  std::vector<afs_object_handle_def_t> handles(100);
+  std::vector<afs_object_id_t> object_ids;
+  for (auto& handle : handles) {
+    const afs_object_id_t object_id = afs_object_create(afs_, &handle, &config);
+    ASSERT_NE(object_id, 0);
+    ASSERT_EQ(std::count(object_ids.begin(), object_ids.end(), object_id), 0);
+    object_ids.push_back(object_id);
+  }
+  for (auto& handle : handles) {
+    ASSERT_TRUE(afs_object_close(afs_, &handle));
+  }
+  ASSERT_EQ(afs_size(afs_), 100);
+
+  // Deleting objects and creating new ones should still give unique object IDs, including after remounting
+  for (int i = 0; i < 50; i++) {
+    afs_object_delete(afs_, object_ids[i]);
+  }
+  afs_deinit(afs_);
+  afs_init_t init_afs;
+  test_storage_get_afs_init(&init_afs);
+  afs_init(afs_, &init_afs);
+  for (int i = 0; i < 50; i++) {
+    const afs_object_id_t object_id = afs_object_create(afs_, &handles[i], &config);
+    ASSERT_NE(object_id, 0);
+    ASSERT_EQ(std::count(object_ids.begin() + 50, object_ids.end(), object_id), 0);
+    object_ids.push_back(object_id);
+    ASSERT_TRUE(afs_object_close(afs_, &handles[i]));
+  }
+  ASSERT_EQ(afs_size(afs_), 100);
+
+  // Object IDs should use the full 32 bits and still be found after remounting
+  ASSERT_TRUE(std::any_of(object_ids.begin(), object_ids.end(), [](afs_object_id_t id) { return id > UINT16_MAX; }));
+  afs_deinit(afs_);
+  afs_init(afs_, &init_afs);
+  for (size_t i = 50; i < object_ids.size(); i++) {
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 1);
+  }
+}
+
+#if AFS_32BIT_BLOCKS
+// Small blocks keep the size of storage with more than 65535 blocks manageable
+#define LARGE_NUM_BLOCKS              70000
+#define LARGE_BLOCK_SIZE              1024
+#define LARGE_READ_WRITE_SIZE         256
+#define LARGE_CHECKPOINT_SIZE         AFS_CHECKPOINT_SIZE(LARGE_NUM_BLOCKS, LARGE_READ_WRITE_SIZE)
+
+static std::vector<uint8_t> m_large_storage;
+static std::vector<uint8_t> m_large_checkpoint;
+
+static void large_read_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  ASSERT_LT(block, LARGE_NUM_BLOCKS);
+  memcpy(buf, &m_large_storage[(uint64_t)block * LARGE_BLOCK_SIZE + offset], length);
+}
+
+static void large_write_func(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  ASSERT_LT(block, LARGE_NUM_BLOCKS);
+  memcpy(&m_large_storage[(uint64_t)block * LARGE_BLOCK_SIZE + offset], buf, length);
+}
+
+static void large_erase_func(afs_block_t block) {
+  ASSERT_LT(block, LARGE_NUM_BLOCKS);
+  memset(&m_large_storage[(uint64_t)block * LARGE_BLOCK_SIZE], 0, LARGE_BLOCK_SIZE);
+}
+
+static void large_checkpoint_read_func(uint8_t* buf, uint32_t offset, uint32_t length) {
+  memcpy(buf, &m_large_checkpoint[offset], length);
+}
+
+static void large_checkpoint_write_func(const uint8_t* buf, uint32_t offset, uint32_t length) {
+  memcpy(&m_large_checkpoint[offset], buf, length);
+}
+
+TEST_F(AFSFixture, LargeBlockNumbers) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[LARGE_READ_WRITE_SIZE];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  std::vector<uint8_t> write_data(64 * 1024);
+  for (size_t i = 0; i < write_data.size(); i++) {
+    write_data[i] = (uint8_t)(i * 7);
+  }
+  m_large_storage.assign((uint64_t)LARGE_NUM_BLOCKS * LARGE_BLOCK_SIZE, 0);
+  m_large_checkpoint.assign(LARGE_CHECKPOINT_SIZE, 0);
+
+  // Reinit AFS with storage which has more than 65535 blocks
+  static uint8_t read_write_buffer[LARGE_READ_WRITE_SIZE];
+  std::vector<uint8_t> lookup_table_buffer(AFS_LOOKUP_TABLE_SIZE(LARGE_NUM_BLOCKS));
+  auto remount = [&]() {
+    afs_deinit(afs_);
+    const afs_init_t init_afs = {
+      .storage_config = {
+        .block_size = LARGE_BLOCK_SIZE,
+        .num_blocks = LARGE_NUM_BLOCKS,
+        .sub_blocks_per_block = 4,
+        .min_read_write_size = LARGE_READ_WRITE_SIZE,
+        .read = large_read_func,
+        .write = large_write_func,
+        .erase = large_erase_func,
+      },
+      .read_write_buffer = read_write_buffer,
+      .lookup_table_buffer = lookup_table_buffer.data(),
+      .checkpoint_config = {
+        .size = LARGE_CHECKPOINT_SIZE,
+        .read = large_checkpoint_read_func,
+        .write = large_checkpoint_write_func,
+      },
+    };
+    afs_init(afs_, &init_afs);
+  };
+  remount();
+  afs_usage_t usage;
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_free_blocks, LARGE_NUM_BLOCKS);
+
+  // Fill up the first 65536 blocks (blocks are allocated in order while they're all free), using two objects since an
+  // object can't have more than 65535 blocks
+  const afs_object_id_t object_id1 = afs_object_create(afs_, obj, &config);
+  while (afs_size(afs_) < 32768) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data.data(), write_data.size()));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  const afs_object_id_t object_id2 = afs_object_create(afs_, obj, &config);
+  while (afs_size(afs_) < 65536) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data.data(), write_data.size()));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  const afs_block_t filler_num_blocks = afs_size(afs_);
+  ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id1) + afs_object_get_num_blocks(afs_, object_id2), filler_num_blocks);
+
+  // Write another object, which has to use blocks beyond the 16-bit range
+  const afs_object_id_t object_id3 = afs_object_create(afs_, obj, &config);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(afs_object_write(afs_, obj, 0, write_data.data(), write_data.size()));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  const afs_block_t object3_num_blocks = afs_object_get_num_blocks(afs_, object_id3);
+  ASSERT_GT(object3_num_blocks, 1);
+
+  // The objects should be found again after remounting, both with and without a checkpoint
+  auto verify_objects = [&]() {
+    ASSERT_EQ(afs_size(afs_), filler_num_blocks + object3_num_blocks);
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_id3), object3_num_blocks);
+    ASSERT_TRUE(afs_object_open(afs_, obj, 0, object_id3, &config));
+    ASSERT_EQ(afs_object_size(afs_, obj, 0), write_data.size() * 4);
+    std::vector<uint8_t> read_data(write_data.size());
+    for (int i = 0; i < 4; i++) {
+      ASSERT_EQ(afs_object_read(afs_, obj, read_data.data(), read_data.size(), NULL), read_data.size());
+      ASSERT_TRUE(read_data == write_data);
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  };
+  remount();
+  verify_objects();
+  ASSERT_TRUE(afs_checkpoint(afs_));
+  remount();
+  verify_objects();
+
+  // Deleting the third object via the tombstone should stick across a remount
+  afs_object_delete_deferred(afs_, object_id3);
+  remount();
+  ASSERT_EQ(afs_size(afs_), filler_num_blocks);
+  ASSERT_FALSE(afs_object_open(afs_, obj, 0, object_id3, &config));
+  ASSERT_EQ(afs_idle_work(afs_, 0, 0), true);
+  afs_get_usage(afs_, &usage);
+  ASSERT_EQ(usage.num_free_blocks, LARGE_NUM_BLOCKS - filler_num_blocks);
+}
+#endif
+
+// Verify that seeking within blocks which have seek tables works and reads less data
+TEST_F(AFSFixture, SeekTable) {
+  AFS_OBJECT_HANDLE_DEF(obj);
+  static uint8_t buffer[1024];
+  static uint32_t seek_table_buffer[AFS_SEEK_TABLE_BUFFER_SIZE(8, 2) / sizeof(uint32_t)];
+  const afs_object_config_t config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+  };
+  const afs_object_config_t seek_table_config = {
+    .buffer = buffer,
+    .buffer_size = sizeof(buffer),
+    .seek_table_buffer = seek_table_buffer,
+    .seek_table_buffer_size = sizeof(seek_table_buffer),
+  };
+  static uint32_t write_data[2][64 * 1024 / sizeof(uint32_t)];
+
+  // Create two identical objects with two interleaved streams which span multiple blocks, one of which has seek tables
+  afs_object_id_t object_ids[2];
+  for (int i = 0; i < 2; i++) {
+    object_ids[i] = afs_object_create(afs_, obj, i ? &seek_table_config : &config);
+    uint32_t value[2] = {0, 0};
+    for (int j = 0; j < 120; j++) {
+      for (uint8_t stream = 0; stream < 2; stream++) {
+        const uint32_t length = stream ? sizeof(write_data[stream]) / 4 : sizeof(write_data[stream]);
+        for (uint32_t k = 0; k < length / sizeof(uint32_t); k++) {
+          write_data[stream][k] = value[stream]++ | ((uint32_t)stream << 31);
+        }
+        ASSERT_TRUE(afs_object_write(afs_, obj, stream, (const uint8_t*)write_data[stream], length));
+      }
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+    ASSERT_EQ(afs_object_get_num_blocks(afs_, object_ids[i]), 3);
+  }
+
+  // Seek around each stream of both objects
+  uint64_t bytes_read[2];
+  for (int i = 0; i < 2; i++) {
+    const uint64_t start_bytes_read = test_storage_get_num_bytes_read();
+    for (uint8_t stream = 0; stream < 2; stream++) {
+      ASSERT_TRUE(afs_object_open(afs_, obj, stream, object_ids[i], &config));
+      const uint64_t size = afs_object_size(afs_, obj, 0);
+      ASSERT_EQ(size, 120 * sizeof(write_data[stream]) / (stream ? 4 : 1));
+      for (uint64_t offset : {size / 2, size / 7, size - 1, size * 3 / 5, (uint64_t)0, size / 3}) {
+        offset &= ~(uint64_t)(sizeof(uint32_t) - 1);
+        afs_read_position_t start_pos;
+        afs_object_save_read_position(afs_, obj, &start_pos);
+        ASSERT_TRUE(afs_object_seek(afs_, obj, offset));
+        uint32_t value;
+        ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+        ASSERT_EQ(value, (offset / sizeof(uint32_t)) | ((uint32_t)stream << 31));
+        afs_object_restore_read_position(afs_, obj, &start_pos);
+      }
+      ASSERT_TRUE(afs_object_close(afs_, obj));
+    }
+    bytes_read[i] = test_storage_get_num_bytes_read() - start_bytes_read;
+  }
+
+  // Seeking using the seek tables should have read less data
+  ASSERT_LT(bytes_read[1], bytes_read[0]);
+
+  // Reading the object with seek tables sequentially should skip over them
+  ASSERT_TRUE(afs_object_open(afs_, obj, 1, object_ids[1], &config));
+  uint32_t read_data[sizeof(write_data[1]) / 4 / sizeof(uint32_t)];
+  for (uint32_t j = 0; j < 120; j++) {
+    ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)read_data, sizeof(read_data), NULL), sizeof(read_data));
+    for (uint32_t k = 0; k < sizeof(read_data) / sizeof(uint32_t); k++) {
+      ASSERT_EQ(read_data[k], (j * (sizeof(read_data) / sizeof(uint32_t)) + k) | (1u << 31));
+    }
+  }
+  uint32_t value;
+  ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), 0);
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+
+  // The seek table grows as streams are written to a block, so writing a stream for the first time at any point within a
+  // block should still leave room for it (the second stream is only written once a random amount of the first has been)
+  const afs_object_id_t object_id = afs_object_create(afs_, obj, &seek_table_config);
+  uint32_t values[2] = {0, 0};
+  srand(1234);
+  for (int i = 0; i < 400; i++) {
+    const uint8_t stream = (i % 8 == 7) ? 1 : 0;
+    const uint32_t length = (rand() % (sizeof(write_data[stream]) / sizeof(uint32_t)) + 1) * sizeof(uint32_t);
+    for (uint32_t k = 0; k < length / sizeof(uint32_t); k++) {
+      write_data[stream][k] = values[stream]++;
+    }
+    ASSERT_TRUE(afs_object_write(afs_, obj, stream, (const uint8_t*)write_data[stream], length));
+  }
+  ASSERT_TRUE(afs_object_close(afs_, obj));
+  ASSERT_GT(afs_object_get_num_blocks(afs_, object_id), 2);
+  for (uint8_t stream = 0; stream < 2; stream++) {
+    ASSERT_TRUE(afs_object_open(afs_, obj, stream, object_id, &config));
+    for (uint32_t j = 0; j < values[stream]; j++) {
+      ASSERT_EQ(afs_object_read(afs_, obj, (uint8_t*)&value, sizeof(value), NULL), sizeof(value));
+      ASSERT_EQ(value, j);
+    }
+    ASSERT_TRUE(afs_object_close(afs_, obj));
+  }
+}
+
 // A less structured test of most of the APIs
 TEST_F(AFSFixture, Complete) {
   AFS_OBJECT_HANDLE_DEF(obj1);
@@ -694,7 +2180,7 @@ TEST_F(AFSFixture, Complete) {
   randomize_write_data(write_data[1], sizeof(write_data[1]));
 
   // Create the first object
-  const uint16_t object_id1 = afs_object_create(afs_, obj1, &config1);
+  const afs_object_id_t object_id1 = afs_object_create(afs_, obj1, &config1);
 
   // Write to the first object
   for (int i = 0; i < 30; i++) {
@@ -702,7 +2188,7 @@ TEST_F(AFSFixture, Complete) {
   }
 
   // Create the second object
-  const uint16_t object_id2 = afs_object_create(afs_, obj2, &config2);
+  const afs_object_id_t object_id2 = afs_object_create(afs_, obj2, &config2);
 
   // Write to both objects
   for (int i = 0; i < 100; i++) {
@@ -740,7 +2226,7 @@ TEST_F(AFSFixture, Complete) {
 
   // Test seeking in each file
   afs_object_list_entry_t entry2 = {0};
-  uint16_t first_object_id = 0;
+  afs_object_id_t first_object_id = 0;
   while (afs_object_list(afs_, &entry2)) {
     first_object_id = first_object_id ? first_object_id : entry2.object_id;
     ASSERT_TRUE(afs_object_open(afs_, obj1, 1, entry2.object_id, &config1));
@@ -3,6 +3,8 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <atomic>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
@@ -59,14 +61,38 @@ bool operator==(const HexValue64& lhs, const HexValue64& rhs) {
     m_exp_offset += LENGTH; \
   })
 
+#define CHECKPOINT_SIZE               AFS_CHECKPOINT_SIZE(NUM_BLOCKS, READ_WRITE_SIZE)
+
 static uint8_t* m_storage;
 static uint32_t m_exp_offset;
+static uint8_t m_checkpoint[CHECKPOINT_SIZE];
+static std::atomic<uint32_t> m_num_block_header_reads;
+static uint32_t m_max_read_length;
+static uint32_t m_max_write_length;
+static uint32_t m_num_read_multi_calls;
+static uint32_t m_num_async_writes;
+static uint32_t m_num_async_reads;
+static uint32_t m_num_erases;
+static uint32_t m_num_erase_ranges;
+static uint64_t m_num_bytes_read;
+static uint32_t m_num_checkpoint_bytes_written;
+static struct {
+  const uint8_t* buf;
+  afs_block_t block;
+  uint32_t offset;
+  uint32_t length;
+} m_pending_async_write, m_pending_async_read;
 
-static void read_func(uint8_t* buf, uint16_t block, uint32_t offset, uint32_t length) {
+static void read_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
   ASSERT_TRUE(block < NUM_BLOCKS);
   ASSERT_TRUE((uint64_t)length + (uint64_t)offset <= BLOCK_SIZE);
   ASSERT_EQ(offset % READ_WRITE_SIZE, 0);
   ASSERT_EQ(length % READ_WRITE_SIZE, 0);
+  if (offset == 0) {
+    m_num_block_header_reads++;
+  }
+  m_max_read_length = std::max(m_max_read_length, length);
+  m_num_bytes_read += length;
   memcpy(buf, &m_storage[(uint64_t)block * BLOCK_SIZE + offset], length);
 #if ENABLE_IO_PRINTS
   if (block == 0) {
@@ -79,7 +105,7 @@ static void read_func(uint8_t* buf, uint16_t block, uint32_t offset, uint32_t le
 #endif
 }
 
-static void write_func(const uint8_t* buf, uint16_t block, uint32_t offset, uint32_t length) {
+static void write_func(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
   ASSERT_TRUE(block < NUM_BLOCKS);
   ASSERT_TRUE((uint64_t)length + (uint64_t)offset <= BLOCK_SIZE);
   ASSERT_EQ(offset % READ_WRITE_SIZE, 0);
@@ -93,17 +119,102 @@ static void write_func(const uint8_t* buf, uint16_t block, uint32_t offset, uint
     }
   }
 #endif
+  m_max_write_length = std::max(m_max_write_length, length);
   memcpy(&m_storage[(uint64_t)block * BLOCK_SIZE + offset], buf, length);
 }
 
-static void erase_func(uint16_t block) {
+static void write_async_func(const uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  // Only a single write should be in flight at a time
+  ASSERT_TRUE(m_pending_async_write.buf == NULL);
+  m_num_async_writes++;
+  m_pending_async_write = {
+    .buf = buf,
+    .block = block,
+    .offset = offset,
+    .length = length,
+  };
+}
+
+static void write_async_wait_func(const uint8_t* buf) {
+  // Don't actually write the data until now, so that it's corrupted if AFS modified the buffer in the meantime
+  ASSERT_TRUE(m_pending_async_write.buf == buf);
+  m_pending_async_write.buf = NULL;
+  write_func(buf, m_pending_async_write.block, m_pending_async_write.offset, m_pending_async_write.length);
+}
+
+static void read_async_func(uint8_t* buf, afs_block_t block, uint32_t offset, uint32_t length) {
+  // Only a single read should be in flight at a time
+  ASSERT_TRUE(m_pending_async_read.buf == NULL);
+  m_num_async_reads++;
+  m_pending_async_read = {
+    .buf = buf,
+    .block = block,
+    .offset = offset,
+    .length = length,
+  };
+  // Fill the buffer with garbage until the read completes
+  memset(buf, 0xa5, length);
+}
+
+static void read_async_wait_func(uint8_t* buf) {
+  ASSERT_TRUE(m_pending_async_read.buf == buf);
+  m_pending_async_read.buf = NULL;
+  read_func(buf, m_pending_async_read.block, m_pending_async_read.offset, m_pending_async_read.length);
+}
+
+static void erase_func(afs_block_t block) {
+  ASSERT_TRUE(m_pending_async_write.buf == NULL);
+  m_num_erases++;
   memset(&m_storage[(uint64_t)block * BLOCK_SIZE], 0, BLOCK_SIZE);
 }
 
+static void erase_range_func(afs_block_t first_block, afs_block_t num_blocks) {
+  ASSERT_TRUE(m_pending_async_write.buf == NULL);
+  ASSERT_TRUE(num_blocks > 1);
+  ASSERT_TRUE((uint32_t)first_block + num_blocks <= NUM_BLOCKS);
+  m_num_erase_ranges++;
+  memset(&m_storage[(uint64_t)first_block * BLOCK_SIZE], 0, (uint64_t)num_blocks * BLOCK_SIZE);
+}
+
+static void read_multi_func(const afs_read_request_t* requests, uint32_t num_requests) {
+  m_num_read_multi_calls++;
+  for (uint32_t i = 0; i < num_requests; i++) {
+    read_func(requests[i].buf, requests[i].block, requests[i].offset, requests[i].length);
+  }
+}
+
+static void checkpoint_read_func(uint8_t* buf, uint32_t offset, uint32_t length) {
+  ASSERT_TRUE((uint64_t)length + (uint64_t)offset <= CHECKPOINT_SIZE);
+  ASSERT_EQ(offset % READ_WRITE_SIZE, 0);
+  ASSERT_EQ(length % READ_WRITE_SIZE, 0);
+  memcpy(buf, &m_checkpoint[offset], length);
+}
+
+static void checkpoint_write_func(const uint8_t* buf, uint32_t offset, uint32_t length) {
+  ASSERT_TRUE((uint64_t)length + (uint64_t)offset <= CHECKPOINT_SIZE);
+  ASSERT_EQ(offset % READ_WRITE_SIZE, 0);
+  ASSERT_EQ(length % READ_WRITE_SIZE, 0);
+  memcpy(&m_checkpoint[offset], buf, length);
+  m_num_checkpoint_bytes_written += length;
+}
+
 void test_storage_init(void) {
   m_storage = (uint8_t*)malloc(STORAGE_SIZE);
   ASSERT_TRUE(m_storage != NULL);
   memset(m_storage, 0, STORAGE_SIZE);
+  memset(m_checkpoint, 0, sizeof(m_checkpoint));
+  m_num_block_header_reads = 0;
+  m_num_read_multi_calls = 0;
+  m_num_async_writes = 0;
+  m_pending_async_write = {};
+  m_num_async_reads = 0;
+  m_num_erases = 0;
+  m_num_erase_ranges = 0;
+  m_num_bytes_read = 0;
+  m_num_checkpoint_bytes_written = 0;
+  m_pending_async_read = {};
+  m_max_read_length = 0;
+  m_max_write_length = 0;
 }
 
 void test_storage_deinit(void) {
@@ -129,17 +240,112 @@ void test_storage_get_afs_init(afs_init_t* init) {
   };
 }
 
-void test_storage_generate_v1_block(uint16_t block, uint16_t object_id, const void* data, uint32_t data_length) {
+void test_storage_get_checkpoint_config(afs_checkpoint_config_t* config) {
+  *config = (afs_checkpoint_config_t) {
+    .size = CHECKPOINT_SIZE,
+    .read = checkpoint_read_func,
+    .write = checkpoint_write_func,
+  };
+}
+
+void test_storage_enable_metadata_cache(afs_init_t* init) {
+  static uint8_t metadata_cache_buffer[AFS_METADATA_CACHE_SIZE(TEST_STORAGE_METADATA_CACHE_NUM_ENTRIES, READ_WRITE_SIZE)];
+  init->metadata_cache_buffer = metadata_cache_buffer;
+  init->metadata_cache_size = sizeof(metadata_cache_buffer);
+}
+
+void test_storage_enable_lookup_table_extents(afs_init_t* init, uint32_t max_extents) {
+  static uint8_t extent_buffer[AFS_LOOKUP_TABLE_EXTENT_SIZE(NUM_BLOCKS)];
+  ASSERT_LE(AFS_LOOKUP_TABLE_EXTENT_SIZE(max_extents), sizeof(extent_buffer));
+  init->lookup_table_extent_buffer = extent_buffer;
+  init->lookup_table_extent_buffer_size = AFS_LOOKUP_TABLE_EXTENT_SIZE(max_extents);
+}
+
+void test_storage_enable_read_multi(afs_init_t* init) {
+  static uint8_t mount_buffer[AFS_MOUNT_BUFFER_SIZE(TEST_STORAGE_READ_MULTI_BATCH_SIZE, READ_WRITE_SIZE)];
+  init->storage_config.read_multi = read_multi_func;
+  init->mount_buffer = mount_buffer;
+  init->mount_buffer_size = sizeof(mount_buffer);
+}
+
+void test_storage_enable_write_async(afs_init_t* init) {
+  init->storage_config.write_async = write_async_func;
+  init->storage_config.write_async_wait = write_async_wait_func;
+}
+
+uint32_t test_storage_get_num_async_writes(void) {
+  return m_num_async_writes;
+}
+
+bool test_storage_is_async_write_pending(void) {
+  return m_pending_async_write.buf != NULL;
+}
+
+void test_storage_enable_read_async(afs_init_t* init) {
+  init->storage_config.read_async = read_async_func;
+  init->storage_config.read_async_wait = read_async_wait_func;
+}
+
+uint32_t test_storage_get_num_async_reads(void) {
+  return m_num_async_reads;
+}
+
+bool test_storage_is_async_read_pending(void) {
+  return m_pending_async_read.buf != NULL;
+}
+
+uint64_t test_storage_get_num_bytes_read(void) {
+  return m_num_bytes_read;
+}
+
+uint32_t test_storage_get_num_erases(void) {
+  return m_num_erases;
+}
+
+void test_storage_enable_erase_range(afs_init_t* init) {
+  init->storage_config.erase_range = erase_range_func;
+}
+
+uint32_t test_storage_get_num_erase_ranges(void) {
+  return m_num_erase_ranges;
+}
+
+uint32_t test_storage_get_num_read_multi_calls(void) {
+  return m_num_read_multi_calls;
+}
+
+uint32_t test_storage_get_num_checkpoint_bytes_written(void) {
+  return m_num_checkpoint_bytes_written;
+}
+
+void test_storage_corrupt_checkpoint(void) {
+  // Flip a bit within the lookup table data
+  m_checkpoint[READ_WRITE_SIZE] ^= 0x01;
+}
+
+uint32_t test_storage_get_max_read_length(void) {
+  return m_max_read_length;
+}
+
+uint32_t test_storage_get_max_write_length(void) {
+  return m_max_write_length;
+}
+
+uint32_t test_storage_get_num_block_header_reads(void) {
+  return m_num_block_header_reads;
+}
+
+static void generate_legacy_block(afs_block_t block, magic_value_t magic, uint16_t object_id, const void* data, uint32_t data_length) {
   uint8_t* storage_ptr = &m_storage[(uint64_t)block * BLOCK_SIZE];
 
-  // Write the block header
+  // Write the block header (which doesn't have the upper 16 bits of the object ID)
   block_header_t header = {
-    .magic.val = HEADER_MAGIC_VALUE_V1.val,
+    .magic = magic,
     .object_id = object_id,
     .object_block_index = 0,
   };
-  memcpy(storage_ptr, &header, sizeof(header));
-  storage_ptr += sizeof(header);
+  memcpy(storage_ptr, &header, BLOCK_HEADER_V2_LENGTH);
+  storage_ptr += BLOCK_HEADER_V2_LENGTH;
 
   // Write the data chunk for stream 1
   const uint32_t data_chunk_header1 = (0xd1 << 24) | data_length;
@@ -161,6 +367,14 @@ void test_storage_generate_v1_block(uint16_t block, uint16_t object_id, const vo
   storage_ptr += sizeof(end_chunk);
 }
 
+void test_storage_generate_v1_block(afs_block_t block, uint16_t object_id, const void* data, uint32_t data_length) {
+  generate_legacy_block(block, HEADER_MAGIC_VALUE_V1, object_id, data, data_length);
+}
+
+void test_storage_generate_v2_block(afs_block_t block, uint16_t object_id, const void* data, uint32_t data_length) {
+  generate_legacy_block(block, HEADER_MAGIC_VALUE_V2, object_id, data, data_length);
+}
+
 void test_storage_raw_write(uint64_t offset, const void* data, uint32_t length) {
   memcpy(&m_storage[offset], data, length);
 }
@@ -207,17 +421,19 @@ void assert_storage_expectations_start(void) {
   memcpy(&actual, &m_storage[m_exp_offset], sizeof(actual));
   m_exp_offset += sizeof(actual);
 
-  const uint32_t EXPECTED_MAGIC = ((uint32_t)'A') | (((uint32_t)'F') << 8) | (((uint32_t)'S') << 16) | (((uint32_t)'2') << 24);
+  const uint32_t EXPECTED_MAGIC = ((uint32_t)'A') | (((uint32_t)'F') << 8) | (((uint32_t)'S') << 16) | (((uint32_t)'3') << 24);
   CUSTOM_ASSERTION_ASSERT_EQ("magic", actual.magic.val, EXPECTED_MAGIC);
-  CUSTOM_ASSERTION_ASSERT_EQ("object_id", actual.object_id, exp.object_id);
+  CUSTOM_ASSERTION_ASSERT_EQ("object_id", actual.object_id, (uint16_t)exp.object_id);
   CUSTOM_ASSERTION_ASSERT_EQ("object_block_index", actual.object_block_index, exp.object_block_index);
+  CUSTOM_ASSERTION_ASSERT_EQ("object_id_high", actual.object_id_high, exp.object_id >> 16);
+  CUSTOM_ASSERTION_ASSERT_EQ("reserved", actual.reserved, 0);
   return ::testing::AssertionSuccess();
 }
 
 ::testing::AssertionResult BlockHeaderV1Exp::Assert(const char* exp1, const BlockHeaderV1Exp& exp) const {
   block_header_t header;
-  memcpy(&header, &m_storage[m_exp_offset], sizeof(header));
-  m_exp_offset += sizeof(header);
+  memcpy(&header, &m_storage[m_exp_offset], BLOCK_HEADER_V2_LENGTH);
+  m_exp_offset += BLOCK_HEADER_V2_LENGTH;
 
   const uint32_t EXPECTED_MAGIC = ((uint32_t)'A') | (((uint32_t)'F') << 8) | (((uint32_t)'S') << 16) | (((uint32_t)'1') << 24);
   CUSTOM_ASSERTION_ASSERT_EQ("magic", header.magic.val, EXPECTED_MAGIC);
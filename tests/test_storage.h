@@ -9,11 +9,14 @@ extern "C" {
 
 #include "gtest/gtest.h"
 
+#define TEST_STORAGE_READ_MULTI_BATCH_SIZE 16
+#define TEST_STORAGE_METADATA_CACHE_NUM_ENTRIES 32
+
 #define STORAGE_EXPECTATIONS_START() \
   assert_storage_expectations_start()
 
 struct BlockHeaderExp {
-  uint16_t object_id;
+  afs_object_id_t object_id;
   uint16_t object_block_index;
   ::testing::AssertionResult Assert(const char* exp1, const BlockHeaderExp& exp) const;
 };
@@ -129,7 +132,49 @@ void test_storage_deinit(void);
 
 void test_storage_get_afs_init(afs_init_t* init);
 
-void test_storage_generate_v1_block(uint16_t block, uint16_t object_id, const void* data, uint32_t data_length);
+void test_storage_get_checkpoint_config(afs_checkpoint_config_t* config);
+
+void test_storage_enable_metadata_cache(afs_init_t* init);
+
+void test_storage_enable_lookup_table_extents(afs_init_t* init, uint32_t max_extents);
+
+void test_storage_enable_read_multi(afs_init_t* init);
+
+uint32_t test_storage_get_num_read_multi_calls(void);
+
+uint32_t test_storage_get_num_erases(void);
+
+void test_storage_enable_erase_range(afs_init_t* init);
+
+uint32_t test_storage_get_num_erase_ranges(void);
+
+void test_storage_enable_write_async(afs_init_t* init);
+
+uint32_t test_storage_get_num_async_writes(void);
+
+bool test_storage_is_async_write_pending(void);
+
+void test_storage_enable_read_async(afs_init_t* init);
+
+uint32_t test_storage_get_num_async_reads(void);
+
+bool test_storage_is_async_read_pending(void);
+
+uint64_t test_storage_get_num_bytes_read(void);
+
+uint32_t test_storage_get_num_checkpoint_bytes_written(void);
+
+void test_storage_corrupt_checkpoint(void);
+
+uint32_t test_storage_get_max_read_length(void);
+
+uint32_t test_storage_get_max_write_length(void);
+
+uint32_t test_storage_get_num_block_header_reads(void);
+
+void test_storage_generate_v1_block(afs_block_t block, uint16_t object_id, const void* data, uint32_t data_length);
+
+void test_storage_generate_v2_block(afs_block_t block, uint16_t object_id, const void* data, uint32_t data_length);
 
 void assert_storage_expectations_start(void);
 